@@ -9,3 +9,13 @@ set(CMAKE_FIND_ROOT_PATH /usr/arm-linux)
 set(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
 set(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
 set(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
+
+# ARMv3 has no FPU; keep floats off the display path.
+set(ROVERDISPLAY_FIXED_POINT ON CACHE BOOL "Keep channel values in fixed point, for targets without an FPU")
+
+# Lets "make perfcheck" run the ARM build on the host.
+find_program(QEMU_ARM qemu-arm)
+
+if(QEMU_ARM)
+	set(CMAKE_CROSSCOMPILING_EMULATOR ${QEMU_ARM} -L ${CMAKE_FIND_ROOT_PATH})
+endif()
@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# footprint.sh <roverdisplay> [arguments ...]
+#
+# Reports what one roverdisplay binary costs to carry and to start: file and
+# section sizes, the shared libraries it asks for, how long it takes from
+# exec to the first screen, and its resident memory once running. Run it
+# once per binary (roverdisplay and roverdisplay-lite, say) with the same
+# arguments, e.g. a --replay log, so that both draw the same thing.
+#
+# The program runs under script(1) on a pseudo-terminal with TERM=vt100.
+# Startup is the median of FOOTPRINT_RUNS (default 9) launches, timed to the
+# first appearance of the screen title, polled every millisecond or so; the
+# memory figures come from /proc after FOOTPRINT_SETTLE seconds (default 2).
+
+if [ $# -lt 1 ]; then
+	echo "Usage: $0 <roverdisplay> [arguments ...]" >&2
+	exit 2
+fi
+
+bin=$1
+shift
+
+runs=${FOOTPRINT_RUNS:-9}
+settle=${FOOTPRINT_SETTLE:-2}
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+now_us() {
+	echo $(($(date +%s%N) / 1000))
+}
+
+# start bin on a pty, leaving its pid in $tmp/pid and its output in $tmp/out
+launch() {
+	rm -f "$tmp/pid" "$tmp/out"
+	: > "$tmp/out"
+	TERM=vt100 script -qfc "echo \$\$ > $tmp/pid; exec $bin $*" "$tmp/out" < /dev/null > /dev/null 2>&1 &
+}
+
+stop() {
+	[ -s "$tmp/pid" ] && kill -INT "$(cat "$tmp/pid")" 2> /dev/null
+	wait
+}
+
+echo "Binary: $bin"
+echo "File size: $(wc -c < "$bin") bytes"
+size "$bin" | tail -n 1 | awk '{ printf "Sections: text %s, data %s, bss %s\n", $1, $2, $3 }'
+echo "Needs: $(readelf -d "$bin" | sed -n 's/.*(NEEDED).*\[\(.*\)\]/\1/p' | tr '\n' ' ')"
+
+i=0
+
+while [ $i -lt $runs ]; do
+	start=$(now_us)
+	launch "$@"
+
+	while ! grep -q RoverDisplay "$tmp/out" 2> /dev/null; do
+		sleep 0.001
+	done
+
+	echo $(($(now_us) - start)) >> "$tmp/startup"
+	stop
+	i=$((i + 1))
+done
+
+sort -n "$tmp/startup" | awk '{ t[NR] = $1 } END { printf "Startup: median %.1f ms (min %.1f, max %.1f, %d runs)\n", t[int((NR + 1) / 2)] / 1000, t[1] / 1000, t[NR] / 1000, NR }'
+
+launch "$@"
+sleep "$settle"
+awk '/^Vm(RSS|HWM)|^Rss(Anon|File)/ { printf "%s %s kB\n", $1, $2 }' "/proc/$(cat "$tmp/pid")/status"
+stop
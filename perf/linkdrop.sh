@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# linkdrop.sh <roverdisplay> <cuxsim>
+#
+# Streams csv from a simulated ECU, kills the simulator partway through and
+# starts it again on the same link a few seconds later. Fails if any record
+# is stamped inside the outage, since every one of those would be the last
+# good values passed off as new, or if none arrive once the simulator is
+# back.
+#
+# LINKDROP_DOWN_S sets how long the link stays down (default 4).
+
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 <roverdisplay> <cuxsim>" >&2
+	exit 2
+fi
+
+rover=$1
+sim=$2
+downS=${LINKDROP_DOWN_S:-4}
+# a pass already under way when the simulator dies may still finish
+graceMs=500
+dir=$(mktemp -d)
+link=$dir/ttyCUX
+simPid=
+roverPid=
+trap 'kill $simPid $roverPid 2> /dev/null; rm -rf "$dir"' EXIT
+
+now_ms() {
+	date +%s%3N
+}
+
+start_sim() {
+	"$sim" -d -l "$link" > /dev/null &
+	simPid=$!
+
+	while [ ! -e "$link" ]; do
+		sleep 0.1
+	done
+}
+
+start_sim
+"$rover" --headless --format=csv "$link" > "$dir/out.csv" 2> "$dir/err" &
+roverPid=$!
+sleep 3
+
+kill $simPid
+wait $simPid
+downMs=$(now_ms)
+sleep "$downS"
+upMs=$(now_ms)
+start_sim
+sleep 5
+
+kill $roverPid
+wait $roverPid
+simPid=
+roverPid=
+
+awk -F, -v down=$((downMs + graceMs)) -v up="$upMs" '
+	NR == 1 { next }
+	$1 < down { before++ }
+	$1 >= down && $1 < up { during++ }
+	$1 >= up { after++ }
+	END {
+		printf "%d records before the drop, %d during it, %d after\n", before, during, after
+		exit (before == 0) || (during > 0) || (after == 0)
+	}
+' "$dir/out.csv"
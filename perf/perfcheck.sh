@@ -0,0 +1,130 @@
+#!/bin/sh
+#
+# perfcheck.sh [--update] <cuxperf> <baseline> [emulator ...]
+#
+# Runs every cuxperf case and compares it with the baseline, failing if any
+# case got slower than the tolerance allows. Instruction counts are compared
+# where there are any, since they do not depend on what else the machine is
+# doing; otherwise time per operation is.
+#
+# Natively the counts come from the kernel's counter, if it has one. Given an
+# emulator (qemu-arm -L <sysroot>, say) each case runs in its own process,
+# and with PERF_QEMU_PLUGIN pointing at qemu's libinsn.so the instructions of
+# the whole process are counted, less a run of the empty "none" case.
+#
+# --update records the current figures as the new baseline. Without one the
+# check fails, after printing the figures.
+#
+# PERF_INSN_TOLERANCE and PERF_TIME_TOLERANCE are the allowed growth in
+# percent (defaults 3 and 50). Times on a shared or frequency-scaled machine
+# can move by a third between runs, hence the wide default; instruction
+# counts are the figures to trust.
+
+update=0
+
+if [ "$1" = "--update" ]; then
+	update=1
+	shift
+fi
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 [--update] <cuxperf> <baseline> [emulator ...]" >&2
+	exit 2
+fi
+
+perf=$1
+baseline=$2
+shift 2
+
+insnTolerance=${PERF_INSN_TOLERANCE:-3}
+timeTolerance=${PERF_TIME_TOLERANCE:-50}
+cases="render frame convert log"
+repeats=3
+current=$(mktemp)
+trap 'rm -f "$current" "$current.log"' EXIT
+
+# one case under the emulator: cuxperf's own line, with the plugin's count per operation in place of its "-"
+emulated() {
+	name=$1
+	shift
+
+	if [ -z "$PERF_QEMU_PLUGIN" ]; then
+		"$@" "$perf" -r $repeats "$name" | tail -n 1
+		return
+	fi
+
+	"$@" -plugin "$PERF_QEMU_PLUGIN" -d plugin -D "$current.log" "$perf" -r $repeats "$name" | tail -n 1 |
+		awk -v total="$(sed -n 's/^insns: //p' "$current.log")" -v start="$startInsns" -v repeats=$repeats \
+			'{ printf "%s %s %s %.1f\n", $1, $2, $3, (total - start) / ($2 * repeats) }'
+}
+
+if [ $# -eq 0 ]; then
+	"$perf" $cases | tail -n +2 > "$current" || exit 2
+else
+	startInsns=0
+
+	if [ -n "$PERF_QEMU_PLUGIN" ]; then
+		"$@" -plugin "$PERF_QEMU_PLUGIN" -d plugin -D "$current.log" "$perf" -r $repeats none > /dev/null || exit 2
+		startInsns=$(sed -n 's/^insns: //p' "$current.log")
+	fi
+
+	for name in $cases; do
+		emulated "$name" "$@" >> "$current" || exit 2
+	done
+fi
+
+if [ $update -eq 1 ]; then
+	{
+		echo "# cuxperf baseline: case ns/op insns/op"
+		echo "# recorded $(date +%Y-%m-%d) on $(uname -m)${1:+ under $1}"
+		awk '{ print $1, $3, $4 }' "$current"
+	} > "$baseline"
+	echo "Baseline written to $baseline"
+	cat "$current"
+	exit 0
+fi
+
+# a check with nothing to compare against must not pass
+if [ ! -f "$baseline" ]; then
+	echo "No baseline at $baseline; record one with make perfbaseline (--update)." >&2
+	cat "$current"
+	exit 1
+fi
+
+awk -v insnTol="$insnTolerance" -v timeTol="$timeTolerance" '
+	NR == FNR {
+		if($1 !~ /^#/) {
+			baseNs[$1] = $2
+			baseInsns[$1] = $3
+		}
+		next
+	}
+	{
+		name = $1
+		printf "%-10s", name
+
+		if(! (name in baseNs)) {
+			printf " %12.1f ns/op  (not in baseline)\n", $3
+			next
+		}
+
+		if(($4 != "-") && (baseInsns[name] != "-")) {
+			change = ($4 - baseInsns[name]) * 100 / baseInsns[name]
+			printf " %12.1f insns/op %+6.1f%%", $4, change
+			bad = change > insnTol
+		}
+		else {
+			change = ($3 - baseNs[name]) * 100 / baseNs[name]
+			printf " %12.1f ns/op    %+6.1f%%", $3, change
+			bad = change > timeTol
+		}
+
+		if(bad) {
+			printf "  REGRESSION"
+			failed = 1
+		}
+
+		printf "\n"
+	}
+	END { exit failed }
+' "$baseline" "$current"
@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "acquisition.h"
+
+/*
+ * The acquisition thread owns the ECU link and calls read_data() back to
+ * back. After every pass that read something it publishes a full copy of
+ * its ecu_data through a seqlock: the sequence number is odd while the copy
+ * is being written, so a reader that sees the same even number before and
+ * after copying has a consistent snapshot. The writer never waits for the
+ * reader.
+ */
+
+static void* acquisition_thread(void* arg);
+static void publish(read_result result);
+
+static pthread_t thread;
+static pthread_mutex_t linkLock = PTHREAD_MUTEX_INITIALIZER;
+// written by whoever starts and stops the thread, read by the thread each pass
+static int running;
+
+// only touched by the acquisition thread, or by others holding linkLock
+static cux_conn* conn;
+static ecu_data acqData;
+static uint32_t published;
+static session_log* sessionLog;
+static shm_table* table;
+static derived_state* derived;
+static uint32_t windowMs = DERIVED_WINDOW_MS;
+static int resetPeaks;
+
+// the thread adds to it every pass; graphs read it under historyLock
+static pthread_mutex_t historyLock = PTHREAD_MUTEX_INITIALIZER;
+static history* hist;
+
+static unsigned int seq;
+static acq_snapshot shared;
+
+// the last sequence number handed to the reader
+static unsigned int lastSeen;
+
+bool acquisition_start(cux_conn* c, const ecu_data* initial) {
+	sigset_t all, old;
+	int err;
+
+	// only live mode polls here, so only live mode pays for these
+	derived = malloc(sizeof(derived_state));
+	hist = malloc(sizeof(history));
+
+	if(! derived || ! hist) {
+		free(derived);
+		free(hist);
+		return false;
+	}
+
+	conn = c;
+	acqData = *initial;
+	derived_init(derived, windowMs, monotonic_us() / 1000);
+	history_init(hist, monotonic_us() / 1000);
+	__atomic_store_n(&running, 1, __ATOMIC_RELAXED);
+
+	// SIGINT/SIGTERM must reach the main thread's signalfd, so this thread blocks every signal
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	err = pthread_create(&thread, NULL, acquisition_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if(err != 0) {
+		free(derived);
+		free(hist);
+		return false;
+	}
+
+	return true;
+}
+
+void acquisition_stop() {
+
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	free(derived);
+	free(hist);
+
+}
+
+bool acquisition_latest(acq_snapshot* snap) {
+	unsigned int before, after;
+
+	do {
+		before = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+
+		if(before == lastSeen) {
+			return false;
+		}
+
+		if(before & 1) {
+			continue;
+		}
+
+		memcpy(snap, &shared, sizeof(*snap));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+	} while((before & 1) || (before != after));
+
+	lastSeen = before;
+
+	return true;
+}
+
+// Swap the log the thread appends to; the caller owns (and closes) whatever comes back.
+session_log* acquisition_set_log(session_log* log) {
+	session_log* old;
+
+	pthread_mutex_lock(&linkLock);
+	old = sessionLog;
+	sessionLog = log;
+	pthread_mutex_unlock(&linkLock);
+
+	return old;
+}
+
+// Mirror every pass into a shared-memory table as well; set before acquisition_start().
+void acquisition_set_table(shm_table* t) {
+	table = t;
+}
+
+// Rolling window for the derived channels; set before acquisition_start().
+void acquisition_set_window(uint32_t ms) {
+	windowMs = ms;
+}
+
+// Downsampled history of one channel for the graph page; see history_graph().
+int acquisition_graph(SampleType type, uint32_t spanMs, history_point* out, int width) {
+	int n;
+
+	pthread_mutex_lock(&historyLock);
+	n = history_graph(hist, type, spanMs, out, width);
+	pthread_mutex_unlock(&historyLock);
+
+	return n;
+}
+
+// Picked up by the thread after its next pass.
+void acquisition_reset_peaks() {
+	__atomic_store_n(&resetPeaks, 1, __ATOMIC_RELAXED);
+}
+
+// The scheduler and link health are plain fields the thread writes every pass, so wait for it to finish one.
+void acquisition_stats(acq_stats* stats) {
+	int type;
+
+	pthread_mutex_lock(&linkLock);
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		stats->m_polled[type] = get_poll_stats(conn, type, &stats->m_poll[type]);
+		stats->m_timed[type] = get_latency(conn, type, &stats->m_latency[type]);
+	}
+
+	get_link_stats(conn, &stats->m_link);
+	pthread_mutex_unlock(&linkLock);
+
+}
+
+static void* acquisition_thread(void* arg) {
+
+	while(__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		read_result result;
+
+		pthread_mutex_lock(&linkLock);
+		result = read_data(conn, &acqData);
+
+		// a pass that read nothing has nothing to log; its mask is empty, not stale
+		if(sessionLog && (result != readresult_nostatement)) {
+			sessionlog_append(sessionLog, wallclock_ms(), &acqData, acqData.m_sampled);
+		}
+
+		pthread_mutex_unlock(&linkLock);
+
+		if(result == readresult_nostatement) {
+			usleep(ACQ_IDLE_US);
+		}
+		else {
+			uint64_t now = wallclock_ms();
+			uint64_t nowMono = monotonic_us() / 1000;
+
+			if(__atomic_exchange_n(&resetPeaks, 0, __ATOMIC_RELAXED)) {
+				derived_reset_peaks(derived);
+			}
+
+			derived_update(derived, nowMono, &acqData);
+			publish(result);
+
+			pthread_mutex_lock(&historyLock);
+			history_add(hist, nowMono, &acqData);
+			pthread_mutex_unlock(&historyLock);
+
+			if(table) {
+				shmtable_publish(table, now, &acqData);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static void publish(read_result result) {
+	unsigned int s = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&seq, s + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	shared.m_data = acqData;
+	shared.m_result = result;
+	shared.m_count = ++published;
+	derived_summarise(derived, shared.m_derived);
+
+	__atomic_store_n(&seq, s + 2, __ATOMIC_RELEASE);
+
+}
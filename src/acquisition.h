@@ -0,0 +1,39 @@
+#ifndef ACQUISITION_H
+#define ACQUISITION_H
+
+#include "cuxinterface.h"
+#include "sessionlog.h"
+#include "shmtable.h"
+#include "derived.h"
+#include "history.h"
+
+// How long the acquisition thread rests when nothing was due.
+#define ACQ_IDLE_US 5000
+
+typedef struct acq_snapshot {
+	ecu_data m_data;
+	read_result m_result;
+	uint32_t m_count;
+	derived_summary m_derived[derived_count];
+	} acq_snapshot;
+
+// The link's timing figures, copied out together under the link lock.
+typedef struct acq_stats {
+	bool m_polled[SampleType_NumSampleTypes];
+	poll_stats m_poll[SampleType_NumSampleTypes];
+	bool m_timed[SampleType_NumSampleTypes];
+	latency_summary m_latency[SampleType_NumSampleTypes];
+	link_stats m_link;
+	} acq_stats;
+
+extern bool acquisition_start(cux_conn* c, const ecu_data* initial);
+extern void acquisition_stop();
+extern bool acquisition_latest(acq_snapshot* snap);
+extern session_log* acquisition_set_log(session_log* log);
+extern void acquisition_set_table(shm_table* table);
+extern void acquisition_set_window(uint32_t windowMs);
+extern int acquisition_graph(SampleType type, uint32_t spanMs, history_point* out, int width);
+extern void acquisition_reset_peaks();
+extern void acquisition_stats(acq_stats* stats);
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include "adaptive.h"
+
+/*
+ * Picks a poll interval for a channel from how fast its value is moving.
+ * Each channel has a step, the smallest change worth showing, and the aim is
+ * to read it about once per step of movement. Movement is the larger of the
+ * smoothed rate of change and the smoothed spread of the value, so a noisy
+ * channel that wanders without trending is still followed. Intervals shrink
+ * straight away when a channel starts moving and grow back gradually.
+ *
+ * This runs after every poll, so it sticks to integers: mean and spread are
+ * held in 1024ths of a unit and the rate in finer steps, which the
+ * fixed-point build can afford on a board without an FPU.
+ */
+
+static uint32_t isqrt(uint64_t v);
+
+void adapt_init(adapt_channel* a, uint32_t intervalMs, uint32_t minMs, uint32_t maxMs, uint32_t step) {
+
+	a->m_minMs = minMs;
+	a->m_maxMs = maxMs;
+	a->m_step = step;
+	a->m_intervalMs = intervalMs;
+	a->m_primed = false;
+	a->m_rate = 0;
+	a->m_mean = 0;
+	a->m_var = 0;
+
+}
+
+uint32_t adapt_update(adapt_channel* a, const int32_t* values, int count, uint64_t nowMs) {
+	int64_t delta = 0;
+	int64_t diff, spread, activity;
+	uint64_t target;
+	int i;
+
+	if(a->m_primed && (nowMs > a->m_lastMs)) {
+		for(i = 0; i < count; i++) {
+			int64_t d = llabs((int64_t)values[i] - a->m_last[i]);
+
+			if(d > delta) {
+				delta = d;
+			}
+		}
+
+		a->m_rate += ADAPT_RATE_ALPHA * ((delta * ADAPT_RATE_ONE) / (int64_t)(nowMs - a->m_lastMs) - a->m_rate) / ADAPT_ONE;
+
+		diff = (int64_t)values[0] * ADAPT_ONE - a->m_mean;
+		a->m_mean += ADAPT_VAR_ALPHA * diff / ADAPT_ONE;
+		a->m_var = (ADAPT_ONE - ADAPT_VAR_ALPHA) * (a->m_var + ADAPT_VAR_ALPHA * ((diff * diff) / ADAPT_ONE) / ADAPT_ONE) / ADAPT_ONE;
+
+		// the root of 1024ths is in 32nds
+		spread = (int64_t)isqrt(a->m_var) * (ADAPT_RATE_ONE / 32) / ADAPT_HORIZON_MS;
+		activity = (a->m_rate > spread) ? a->m_rate : spread;
+		target = (activity > 0) ? ((uint64_t)a->m_step * ADAPT_RATE_ONE) / activity : a->m_maxMs;
+
+		if(target < a->m_minMs) {
+			target = a->m_minMs;
+		}
+		else if(target > a->m_maxMs) {
+			target = a->m_maxMs;
+		}
+
+		// narrow at once to catch a transient, widen a quarter of the way per read
+		if(target < a->m_intervalMs) {
+			a->m_intervalMs = target;
+		}
+		else {
+			a->m_intervalMs += ((uint32_t)target - a->m_intervalMs + 3) / 4;
+		}
+	}
+	else if(! a->m_primed) {
+		a->m_mean = (int64_t)values[0] * ADAPT_ONE;
+		a->m_primed = true;
+	}
+
+	for(i = 0; i < count; i++) {
+		a->m_last[i] = values[i];
+	}
+
+	a->m_lastMs = nowMs;
+
+	return a->m_intervalMs;
+}
+
+// Floor of the square root, a bit at a time.
+static uint32_t isqrt(uint64_t v) {
+	uint64_t root = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while(bit > v) {
+		bit >>= 2;
+	}
+
+	while(bit) {
+		if(v >= root + bit) {
+			v -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else {
+			root >>= 1;
+		}
+
+		bit >>= 2;
+	}
+
+	return (uint32_t)root;
+}
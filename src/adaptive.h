@@ -0,0 +1,34 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "samples.h"
+
+// Fractions are kept in 1024ths, so the arithmetic stays integer in either build.
+#define ADAPT_ONE		1024
+// A slow drift is a small fraction of a unit per ms, so rates get finer steps.
+#define ADAPT_RATE_ONE		(1 << 20)
+// Smoothing for the rate of change and for the value spread: 0.3 and 0.1.
+#define ADAPT_RATE_ALPHA	307
+#define ADAPT_VAR_ALPHA		102
+// Spread is turned into a rate by assuming it builds up over this long.
+#define ADAPT_HORIZON_MS	10000
+
+typedef struct adapt_channel {
+	uint32_t m_minMs;
+	uint32_t m_maxMs;
+	uint32_t m_step;
+	uint32_t m_intervalMs;
+	bool m_primed;
+	int32_t m_last[SAMPLE_MAX_VALUES];
+	uint64_t m_lastMs;
+	int64_t m_rate;		// units per ms, scaled by ADAPT_RATE_ONE
+	int64_t m_mean;		// units, in 1024ths
+	int64_t m_var;		// units squared, in 1024ths
+	} adapt_channel;
+
+extern void adapt_init(adapt_channel* a, uint32_t intervalMs, uint32_t minMs, uint32_t maxMs, uint32_t step);
+extern uint32_t adapt_update(adapt_channel* a, const int32_t* values, int count, uint64_t nowMs);
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * This file is part of the RoverDisplay distribution (https://github.com/draget/roverdisplay).
+ * Copyright (c) 2022 Thomas H. Drage.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * cuxbench - drives read_data() at the display's tick rate against a port
+ * (normally cuxsim's pty) and reports the sample rate achieved per channel.
+ * With -c it polls back to back as the acquisition thread does, so the
+ * figures show what the link itself can deliver. Given several ports it
+ * polls them all at once and reports the aggregate; with -l each port
+ * then logs to its own file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "cuxinterface.h"
+#include "sessionlog.h"
+#include "acquisition.h"
+
+#define DEFAULT_SECONDS	30
+
+#define MAX_PORTS	16
+#define MAX_PATH	256
+
+typedef struct bench_port {
+	const char* m_dev;
+	cux_conn* m_conn;
+	ecu_data m_data;
+	session_log* m_log;
+	char m_logPath[MAX_PATH];
+	pthread_t m_thread;
+	unsigned int m_ticks;
+	unsigned int m_failures;
+	} bench_port;
+
+void usage();
+bool log_path(char* out, const char* path, int index, int count);
+void* bench_thread(void* arg);
+void print_log(const bench_port* p);
+
+bench_port ports[MAX_PORTS];
+bool continuous;
+uint64_t began;
+uint64_t end;
+
+int main(int argc, char** argv) {
+	unsigned int seconds = DEFAULT_SECONDS;
+	unsigned int options = 0;
+	const char* logPath = NULL;
+	int count;
+	int opt;
+	int i;
+
+	while((opt = getopt(argc, argv, "s:l:ca")) != -1) {
+		switch(opt) {
+			case 's':
+				seconds = atoi(optarg);
+				break;
+			case 'l':
+				logPath = optarg;
+				break;
+			case 'c':
+				continuous = true;
+				break;
+			case 'a':
+				options |= CUX_OPT_ADAPTIVE;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	count = argc - optind;
+
+	if((count < 1) || (count > MAX_PORTS) || (seconds == 0)) {
+		usage();
+		return 1;
+	}
+
+	for(i = 0; i < count; i++) {
+		ports[i].m_dev = argv[optind + i];
+
+		if(! (ports[i].m_conn = connect_to_ecu(&ports[i].m_data, ports[i].m_dev, options))) {
+			fprintf(stderr, "Could not open serial port %s.\n", ports[i].m_dev);
+			return 1;
+		}
+	}
+
+	for(i = 0; logPath && (i < count); i++) {
+		if(! log_path(ports[i].m_logPath, logPath, i, count)) {
+			fprintf(stderr, "Log path %s is too long.\n", logPath);
+			return 1;
+		}
+
+		if(! (ports[i].m_log = sessionlog_open(ports[i].m_logPath, wallclock_ms()))) {
+			perror(ports[i].m_logPath);
+			return 1;
+		}
+	}
+
+	began = monotonic_us();
+	end = began + (uint64_t)seconds * 1000000;
+
+	// libcomm14cux blocks for the whole of each transaction, so every port gets its own thread
+	for(i = 0; i < count; i++) {
+		if(pthread_create(&ports[i].m_thread, NULL, bench_thread, &ports[i]) != 0) {
+			fprintf(stderr, "Could not start a thread for %s.\n", ports[i].m_dev);
+			return 1;
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		pthread_join(ports[i].m_thread, NULL);
+	}
+
+	float elapsed = (monotonic_us() - began) / 1e6;
+	unsigned int total = 0;
+	unsigned int ticks = 0;
+	unsigned int failures = 0;
+	int type;
+
+	printf("%-20s %8s %10s\n", "Channel", "Samples", "Samples/s");
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		unsigned int reads = 0;
+		bool polled = false;
+		poll_stats st;
+
+		for(i = 0; i < count; i++) {
+			if(get_poll_stats(ports[i].m_conn, type, &st)) {
+				reads += st.m_reads;
+				polled = true;
+			}
+		}
+
+		if(polled) {
+			printf("%-20s %8u %10.2f\n", sample_type_name(type), reads, reads / elapsed);
+			total += reads;
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		ticks += ports[i].m_ticks;
+		failures += ports[i].m_failures;
+	}
+
+	printf("%-20s %8u %10.2f\n", "Total", total, total / elapsed);
+	printf("%u passes in %.1fs, %u failed", ticks, elapsed, failures);
+
+	if(count > 1) {
+		printf(" across %d ports (%.2f samples/s per port)", count, total / elapsed / count);
+	}
+
+	printf("\n");
+
+	for(i = 0; i < count; i++) {
+		if(count > 1) {
+			printf("\n%s: %u passes, %u failed\n", ports[i].m_dev, ports[i].m_ticks, ports[i].m_failures);
+		}
+		else {
+			printf("\n");
+		}
+
+		print_poll_stats(ports[i].m_conn, stdout);
+		print_latency(ports[i].m_conn, stdout);
+
+		if(ports[i].m_log) {
+			print_log(&ports[i]);
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		disconnect_from_ecu(ports[i].m_conn);
+	}
+
+	return 0;
+}
+
+// One port logs to path as given; several log to path with -<index> before its extension.
+bool log_path(char* out, const char* path, int index, int count) {
+	const char* dot = strrchr(path, '.');
+	const char* slash = strrchr(path, '/');
+
+	if(count == 1) {
+		return snprintf(out, MAX_PATH, "%s", path) < MAX_PATH;
+	}
+
+	if(! dot || (slash && (dot < slash))) {
+		dot = path + strlen(path);
+	}
+
+	return snprintf(out, MAX_PATH, "%.*s-%d%s", (int)(dot - path), path, index, dot) < MAX_PATH;
+}
+
+// Closes the port's log, then reports how big it came out.
+void print_log(const bench_port* p) {
+	uint64_t samples = p->m_log->m_samples;
+	struct stat st;
+
+	sessionlog_close(p->m_log);
+
+	if(stat(p->m_logPath, &st) == 0) {
+		printf("Log %s: %llu samples in %llu bytes, %.2f bytes/sample\n", p->m_logPath, (unsigned long long)samples, (unsigned long long)st.st_size, samples ? (float)st.st_size / samples : 0.0);
+	}
+}
+
+void* bench_thread(void* arg) {
+	bench_port* p = arg;
+	struct timespec tick;
+
+	clock_gettime(CLOCK_MONOTONIC, &tick);
+
+	while(monotonic_us() < end) {
+		read_result result = read_data(p->m_conn, &p->m_data);
+
+		if(result == readresult_failure) {
+			p->m_failures++;
+		}
+
+		p->m_ticks++;
+
+		if(p->m_log && (result != readresult_nostatement)) {
+			sessionlog_append(p->m_log, wallclock_ms(), &p->m_data, p->m_data.m_sampled);
+		}
+
+		if(continuous) {
+			if(result == readresult_nostatement) {
+				usleep(ACQ_IDLE_US);
+			}
+			continue;
+		}
+
+		tick.tv_nsec += POLL_PERIOD_MS * 1000000L;
+		if(tick.tv_nsec >= 1000000000L) {
+			tick.tv_sec++;
+			tick.tv_nsec -= 1000000000L;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &tick, NULL);
+	}
+
+	return NULL;
+}
+
+void usage() {
+	fprintf(stderr, "Usage: cuxbench [-s seconds] [-l log.rdl] [-c] [-a] <port>..., e.g. cuxbench -s 60 /tmp/ttyCUX\n"
+			"  -c  poll back to back instead of once per display tick\n"
+			"  -a  adapt poll intervals to how fast each channel is changing\n"
+			"Several ports are polled at once, one thread each; with -l, port n logs to log-n.rdl.\n");
+}
@@ -0,0 +1,49 @@
+#ifndef CUXCONN_H
+#define CUXCONN_H
+
+#include "cuxinterface.h"
+#include "romcache.h"
+#include "latency.h"
+#include "adaptive.h"
+#include "linkhealth.h"
+
+/*
+ * Everything that belongs to one ECU link. Nothing in cuxinterface.c is
+ * shared between connections, so each can be driven from its own thread.
+ */
+struct cux_conn {
+	c14cux_info m_info;
+	char* m_dev;
+	unsigned int m_options;
+	link_health m_link;
+
+	enum c14cux_lambda_trim_type m_lambdaTrimType;
+	enum c14cux_feedback_mode m_feedbackMode;	// follows the fuel map index; see apply_feedback_mode()
+	bool m_modeChanged;
+	uint32_t m_modeChanges;
+	enum c14cux_airflow_type m_airflowType;
+	enum c14cux_throttle_pos_type m_throttlePosType;
+
+	poll_scheduler m_sched;
+	uint64_t m_startUs;
+	adapt_channel m_adapt[SampleType_NumSampleTypes];
+	latency_hist m_latency[SampleType_NumSampleTypes];
+	rom_cache m_rom;
+
+	// fault codes are read between polls, when the tick has serial time to spare
+	uint64_t m_faultsDueMs;
+	uint32_t m_faultReads;
+	uint32_t m_faultFailures;
+	uint32_t m_faultDeferrals;
+
+	// the ROM dump likewise only gets what the tick has left
+	uint32_t m_romSkippedPasses;
+	uint32_t m_romDeferrals;
+
+	// channel whose libcomm14cux calls are being timed, or -1 outside a poll
+	int m_callType;
+	uint64_t m_callStartUs;
+	bool m_callFailed;
+	};
+
+#endif
@@ -1,116 +1,277 @@
+#include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
-#include "cuxinterface.h"
-
-static struct timeval now;
-
-static int lastReadTime[19];
-static int readIntervals[19];
-
-bool is_sample_appropriate_for_mode(SampleType type);
-read_result merge_result(read_result total, bool single);
-uint64_t ms_since_epoch();
+#include "cuxconn.h"
+#include "units.h"
+
+typedef read_result (*poll_fn)(cux_conn* c, ecu_data* dat, read_result result);
+
+typedef struct poll_entry {
+	SampleType m_type;
+	uint8_t m_transactions;
+	uint8_t m_bytes;
+	poll_fn m_poll;
+	} poll_entry;
+
+static read_result poll_maf(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_throttle(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_lambda_trim_short(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_engine_rpm(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_fuel_map_row_col(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_injector_pulse_width(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_idle_bypass(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_lambda_trim_long(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_main_voltage(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_target_idle(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_fuel_pump_relay(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_gear(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_road_speed(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_engine_temp(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_fuel_temp(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_mil(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_co_trim(cux_conn* c, ecu_data* dat, read_result result);
+static read_result poll_fuel_map_index(cux_conn* c, ecu_data* dat, read_result result);
+static read_result read_rpm_limit(cux_conn* c, ecu_data* dat, read_result result);
+static ecu_real from_float(float value, int32_t one);
+static read_result poll_faults(cux_conn* c, ecu_data* dat, uint64_t nowMs);
+static int rom_chunks(cux_conn* c);
+static void apply_feedback_mode(cux_conn* c, uint64_t nowMs);
+static bool reconnect(cux_conn* c, ecu_data* dat, uint64_t nowMs);
+
+static const int readIntervals[SampleType_NumSampleTypes] = {
+	[SampleType_EngineTemperature]  = 1499,
+	[SampleType_RoadSpeed]          = 997,
+	[SampleType_EngineRPM]          = 0,
+	[SampleType_FuelTemperature]    = 1801,
+	[SampleType_MAF]                = 0,
+	[SampleType_Throttle]           = 0,
+	[SampleType_IdleBypassPosition] = 0,
+	[SampleType_TargetIdleRPM]      = 487,
+	[SampleType_GearSelection]      = 563,
+	[SampleType_MainVoltage]        = 283,
+	[SampleType_LambdaTrimShort]    = 0,
+	[SampleType_LambdaTrimLong]     = 331,
+	[SampleType_COTrimVoltage]      = 317,
+	[SampleType_FuelPumpRelay]      = 313,
+	[SampleType_FuelMapRowCol]      = 0,
+	[SampleType_FuelMapData]        = 3511,
+	[SampleType_FuelMapIndex]       = 1201,
+	[SampleType_InjectorPulseWidth] = 0,
+	[SampleType_MIL]                = 347
+	};
+
+// Adaptive mode: interval bounds and the smallest change worth a read, in sample_encode() units.
+static const struct adapt_bounds {
+	uint16_t m_minMs;
+	uint16_t m_maxMs;
+	uint16_t m_step;
+	} adaptBounds[SampleType_NumSampleTypes] = {
+	[SampleType_EngineTemperature]  = { 500, 6000, 1 },
+	[SampleType_RoadSpeed]          = { 200, 4000, 1 },
+	[SampleType_EngineRPM]          = {   0, 1000, 25 },
+	[SampleType_FuelTemperature]    = { 500, 8000, 1 },
+	[SampleType_MAF]                = {   0, 1000, 10 },
+	[SampleType_Throttle]           = {   0, 1000, 10 },
+	[SampleType_IdleBypassPosition] = {   0, 2000, 10 },
+	[SampleType_TargetIdleRPM]      = { 200, 4000, 10 },
+	[SampleType_GearSelection]      = { 200, 3000, 1 },
+	[SampleType_MainVoltage]        = { 200, 3000, 50 },
+	[SampleType_LambdaTrimShort]    = {   0, 1000, 2 },
+	[SampleType_LambdaTrimLong]     = { 200, 4000, 1 },
+	[SampleType_COTrimVoltage]      = { 200, 4000, 20 },
+	[SampleType_FuelPumpRelay]      = { 200, 3000, 1 },
+	[SampleType_FuelMapRowCol]      = {   0, 1000, 4 },
+	[SampleType_FuelMapData]        = {   0,    0, 0 },
+	[SampleType_FuelMapIndex]       = { 500, 5000, 1 },
+	[SampleType_InjectorPulseWidth] = {   0, 1000, 20 },
+	[SampleType_MIL]                = { 200, 3000, 1 }
+	};
+
+// Registration order doubles as the tie-break priority for channels due at the same time.
+static const poll_entry pollTable[] = {
+	{ SampleType_MAF,                1, 2, poll_maf },
+	{ SampleType_Throttle,           1, 2, poll_throttle },
+	{ SampleType_LambdaTrimShort,    2, 4, poll_lambda_trim_short },
+	{ SampleType_EngineRPM,          1, 2, poll_engine_rpm },
+	{ SampleType_FuelMapRowCol,      2, 2, poll_fuel_map_row_col },
+	{ SampleType_InjectorPulseWidth, 1, 2, poll_injector_pulse_width },
+	{ SampleType_IdleBypassPosition, 1, 1, poll_idle_bypass },
+	{ SampleType_LambdaTrimLong,     2, 4, poll_lambda_trim_long },
+	{ SampleType_MainVoltage,        1, 1, poll_main_voltage },
+	{ SampleType_TargetIdleRPM,      2, 3, poll_target_idle },
+	{ SampleType_FuelPumpRelay,      1, 1, poll_fuel_pump_relay },
+	{ SampleType_GearSelection,      1, 1, poll_gear },
+	{ SampleType_RoadSpeed,          1, 1, poll_road_speed },
+	{ SampleType_EngineTemperature,  1, 1, poll_engine_temp },
+	{ SampleType_FuelTemperature,    1, 1, poll_fuel_temp },
+	{ SampleType_MIL,                1, 1, poll_mil },
+	{ SampleType_COTrimVoltage,      1, 1, poll_co_trim },
+	{ SampleType_FuelMapIndex,       1, 1, poll_fuel_map_index }
+	};
+
+#define POLL_TABLE_SIZE (sizeof(pollTable) / sizeof(pollTable[0]))
+
+static const char* sampleTypeNames[SampleType_NumSampleTypes] = {
+	[SampleType_EngineTemperature]  = "Engine temperature",
+	[SampleType_RoadSpeed]          = "Road speed",
+	[SampleType_EngineRPM]          = "Engine speed",
+	[SampleType_FuelTemperature]    = "Fuel temperature",
+	[SampleType_MAF]                = "MAF",
+	[SampleType_Throttle]           = "Throttle",
+	[SampleType_IdleBypassPosition] = "Idle bypass",
+	[SampleType_TargetIdleRPM]      = "Idle target",
+	[SampleType_GearSelection]      = "Gear selection",
+	[SampleType_MainVoltage]        = "Main voltage",
+	[SampleType_LambdaTrimShort]    = "Lambda trim (short)",
+	[SampleType_LambdaTrimLong]     = "Lambda trim (long)",
+	[SampleType_COTrimVoltage]      = "CO trim",
+	[SampleType_FuelPumpRelay]      = "Fuel pump relay",
+	[SampleType_FuelMapRowCol]      = "Fuel map row/col",
+	[SampleType_FuelMapData]        = "Fuel map data",
+	[SampleType_FuelMapIndex]       = "Fuel map index",
+	[SampleType_InjectorPulseWidth] = "Pulse width",
+	[SampleType_MIL]                = "MIL"
+	};
+
+
+
+bool is_sample_appropriate_for_mode(cux_conn* c, SampleType type);
+read_result merge_result(cux_conn* c, read_result total, bool single);
+
+// Returns NULL if the port cannot be opened; options are CUX_OPT_* flags.
+cux_conn* connect_to_ecu(ecu_data* dat, const char* dev, unsigned int options) {
+	cux_conn* c = calloc(1, sizeof(cux_conn));
+	int i;
+
+	if(! c) {
+		return NULL;
+	}
 
-bool connect_to_ecu(ecu_data* dat, const char* dev) {
+	c->m_options = options;
+	// nothing reads the trim type from the ECU, so poll the short-term trim as before
+	c->m_lambdaTrimType = C14CUX_LambdaTrimType_ShortTerm;
+	c->m_callType = -1;
+	c->m_dev = strdup(dev);
+	link_init(&c->m_link);
 
 	dat->m_roadSpeedMPH = 0;
 	dat->m_engineSpeedRPM = 0;
 	dat->m_targetIdleSpeed = 0;
 	dat->m_coolantTempF = 0;
 	dat->m_fuelTempF = 0;
-	dat->m_throttlePos = 0.0;
+	dat->m_throttlePos = 0;
 	dat->m_gear = 0;
-	dat->m_mainVoltage = 0.0;
+	dat->m_mainVoltage = 0;
 	dat->m_fuelMapIndexRead = false;
 	dat->m_currentFuelMapIndex = 0;
 	dat->m_currentFuelMapRowIndex = 0;
 	dat->m_fuelMapRowWeighting = 0;
 	dat->m_currentFuelMapColumnIndex = 0;
 	dat->m_fuelMapColWeighting = 0;
-	dat->m_mafReading = 0.0;
-	dat->m_idleBypassPos = 0.0;
+	dat->m_mafReading = 0;
+	dat->m_idleBypassPos = 0;
 	dat->m_fuelPumpRelayOn = false;
 	dat->m_lambdaTrimOdd = 0;
 	dat->m_lambdaTrimEven = 0;
-	dat->m_coTrimVoltage = 0.0;
+	dat->m_coTrimVoltage = 0;
 	dat->m_milOn = false;
 	dat->m_rpmLimit = 0;
 	dat->m_idleMode = false;
 	dat->m_injectorPulseWidthUs = 0;
-	dat->m_injectorPulseWidthMs = 0.0;
+	dat->m_injectorPulseWidthMs = 0;
 	dat->m_tune = 0;
 	dat->m_checksumFixer = 0;
 	dat->m_ident = 0;
-	dat->m_rowScaler[FUEL_MAP_COUNT] = 0;
-	dat->m_mafScaler = 0;
+	dat->m_romRead = false;
 
     memset(&dat->m_faultCodes, 0, sizeof(dat->m_faultCodes));
+	dat->m_faultsRead = false;
 
+	romcache_reset(&c->m_rom);
 
-	readIntervals[SampleType_EngineTemperature]  = 1499;
-	readIntervals[SampleType_RoadSpeed]          = 997;
-	readIntervals[SampleType_EngineRPM]          = 0;
-	readIntervals[SampleType_FuelTemperature]    = 1801;
-	readIntervals[SampleType_MAF]                = 0;
-	readIntervals[SampleType_Throttle]           = 0;
-	readIntervals[SampleType_IdleBypassPosition] = 0;
-	readIntervals[SampleType_TargetIdleRPM]      = 487;
-	readIntervals[SampleType_GearSelection]      = 563;
-	readIntervals[SampleType_MainVoltage]        = 283;
-	readIntervals[SampleType_LambdaTrimShort]    = 0;
-	readIntervals[SampleType_LambdaTrimLong]     = 331;
-	readIntervals[SampleType_COTrimVoltage]      = 317;
-	readIntervals[SampleType_FuelPumpRelay]      = 313;
-	readIntervals[SampleType_FuelMapRowCol]      = 0;
-	readIntervals[SampleType_FuelMapData]        = 3511;
-	readIntervals[SampleType_FuelMapIndex]       = 1201;
-	readIntervals[SampleType_InjectorPulseWidth] = 0;
-	readIntervals[SampleType_MIL]                = 347;
+	for(i = 0; i < SampleType_NumSampleTypes; i++) {
+		latency_reset(&c->m_latency[i]);
+	}
 
-	int type;
-	for(type = 0; type < SampleType_NumSampleTypes; type++) {
-		lastReadTime[type] = 0;
+	c->m_startUs = monotonic_us();
+	sched_init(&c->m_sched, POLL_PERIOD_MS);
+
+	for(i = 0; i < POLL_TABLE_SIZE; i++) {
+		const poll_entry* e = &pollTable[i];
+		uint32_t cost = (e->m_transactions * SCHED_CMD_BYTES + e->m_bytes) * SCHED_BYTE_US;
+		const struct adapt_bounds* b = &adaptBounds[e->m_type];
+
+		sched_add(&c->m_sched, e->m_type, readIntervals[e->m_type], cost, 0);
+		adapt_init(&c->m_adapt[e->m_type], readIntervals[e->m_type], b->m_minMs, b->m_maxMs, b->m_step);
 	}
 
-	c14cux_init(&cuxinfo);
+	// closed loop until the fuel map index, due on the first tick, says otherwise
+	apply_feedback_mode(c, 0);
 
-	return c14cux_connect(&cuxinfo, dev, C14CUX_BAUD);
+	c14cux_init(&c->m_info);
+
+	if(! c->m_dev || ! c14cux_connect(&c->m_info, dev, C14CUX_BAUD)) {
+		free(c->m_dev);
+		free(c);
+		return NULL;
+	}
+
+	return c;
 
 }
 
-void disconnect_from_ecu() {
+void disconnect_from_ecu(cux_conn* c) {
 
-	bool connected = c14cux_isConnected(&cuxinfo);
+	bool connected = c14cux_isConnected(&c->m_info);
 
 	if(connected) {
-		c14cux_disconnect(&cuxinfo);
+		c14cux_disconnect(&c->m_info);
 	}
 
-}
+	free(c->m_dev);
+	free(c);
 
-read_result read_fault_codes(ecu_data* dat) {
+}
 
-	if(c14cux_isConnected(&cuxinfo)) {
+// Bits set in now but not in before, into set if given; returns how many.
+int fault_diff(const c14cux_faultcodes* before, const c14cux_faultcodes* now, c14cux_faultcodes* set) {
+	const uint8_t* b = (const uint8_t*)before;
+	const uint8_t* n = (const uint8_t*)now;
+	int count = 0;
+	int i;
 
-		memset(&dat->m_faultCodes, 0, sizeof(dat->m_faultCodes));
+	for(i = 0; i < sizeof(c14cux_faultcodes); i++) {
+		uint8_t fresh = n[i] & ~b[i];
 
-		if(c14cux_getFaultCodes(&cuxinfo, &dat->m_faultCodes)) {
-			return readresult_success;
-		}
-		else {
-			return readresult_failure;
+		if(set) {
+			((uint8_t*)set)[i] = fresh;
 		}
 
+		count += __builtin_popcount(fresh);
 	}
 
-	return readresult_nostatement;
-
+	return count;
 }
 
+int fault_count(const c14cux_faultcodes* faults) {
+	c14cux_faultcodes none;
 
-read_result merge_result(read_result total, bool single) {
+	memset(&none, 0, sizeof(none));
+
+	return fault_diff(&none, faults, NULL);
+}
+
+read_result merge_result(cux_conn* c, read_result total, bool single) {
 	read_result result = total;
 
+	// every libcomm14cux call is followed by one merge, which closes its timing
+	if(c->m_callType >= 0) {
+		uint64_t now = monotonic_us();
+
+		latency_record(&c->m_latency[c->m_callType], (uint32_t)(now - c->m_callStartUs), single);
+		c->m_callStartUs = now;
+		c->m_callFailed |= ! single;
+	}
+
 	if(total == readresult_nostatement) {
 		result = single ? readresult_success : readresult_failure;
 	}
@@ -121,248 +282,576 @@ read_result merge_result(read_result total, bool single) {
 	return result;
 }
 
-uint64_t ms_since_epoch() {
-
-	gettimeofday(&now, NULL);
-
-	uint64_t millisecondsSinceEpoch = (uint64_t)(now.tv_sec) * 1000 + (uint64_t)(now.tv_usec) / 1000;
-
-	return millisecondsSinceEpoch;
-
-}
-
-bool is_due_for_measurement(SampleType type) {
-	bool status = false;
-
-	if(is_sample_appropriate_for_mode(type)) {
-		uint64_t now = ms_since_epoch();
-
-		if(now - lastReadTime[type] >= readIntervals[type]) {
-			status = true;
-			lastReadTime[type] = now;
-		}
-	}
-
-	return status;
-}
-
-bool is_sample_appropriate_for_mode(SampleType type) {
+bool is_sample_appropriate_for_mode(cux_conn* c, SampleType type) {
 	bool status = true;
 
 	if (type == SampleType_LambdaTrimLong)
 	{
-		status = (m_feedbackMode == C14CUX_FeedbackMode_ClosedLoop) &&
-						 (m_lambdaTrimType == C14CUX_LambdaTrimType_LongTerm);
+		status = (c->m_feedbackMode == C14CUX_FeedbackMode_ClosedLoop) &&
+						 (c->m_lambdaTrimType == C14CUX_LambdaTrimType_LongTerm);
 	}
 	else if (type == SampleType_LambdaTrimShort)
 	{
-		status = (m_feedbackMode == C14CUX_FeedbackMode_ClosedLoop) &&
-						 (m_lambdaTrimType == C14CUX_LambdaTrimType_ShortTerm);
+		status = (c->m_feedbackMode == C14CUX_FeedbackMode_ClosedLoop) &&
+						 (c->m_lambdaTrimType == C14CUX_LambdaTrimType_ShortTerm);
 	}
 	else if (type == SampleType_COTrimVoltage)
 	{
-		status = (m_feedbackMode == C14CUX_FeedbackMode_OpenLoop);
-	}
-	else if (type == SampleType_FuelMapData)
-	{
-		// only refresh the fuel map data itself if a special option is set
-		status = FUEL_MAP_REFRESH;
+		status = (c->m_feedbackMode == C14CUX_FeedbackMode_OpenLoop);
 	}
 
 	return status;
 }
 
-read_result read_data(ecu_data* dat) {
+read_result read_data(cux_conn* c, ecu_data* dat) {
 	read_result result = readresult_nostatement;
+	read_result rom, faults;
+	uint32_t covered = 0;
+	uint64_t now;
+	int type;
+
+	// one clock read per tick; every channel due at or before this instant is eligible
+	now = (monotonic_us() - c->m_startUs) / 1000;
+
+	// whatever this pass returns, only what it read itself counts as sampled
+	dat->m_sampled = 0;
+
+	if(c->m_link.m_state == linkstate_down) {
+		if(! link_attempt_due(&c->m_link, monotonic_us())) {
+			return readresult_nostatement;
+		}
+
+		if(! reconnect(c, dat, now)) {
+			return readresult_failure;
+		}
+	}
 
 	if(! dat->m_readTuneId) {
-		if(c14cux_getTuneRevision(&cuxinfo, &(dat->m_tune), &(dat->m_checksumFixer), &(dat->m_ident))) dat->m_readTuneId = true;
+		if(c14cux_getTuneRevision(&c->m_info, &(dat->m_tune), &(dat->m_checksumFixer), &(dat->m_ident))) dat->m_readTuneId = true;
 	}
 
-	if (is_due_for_measurement(SampleType_MAF))
-	{
-		result = merge_result(result, c14cux_getMAFReading(&cuxinfo, m_airflowType, &(dat->m_mafReading)));
+	romcache_lookup(&c->m_rom, dat);
+
+	sched_begin_tick(&c->m_sched);
+
+	while((type = sched_next(&c->m_sched, now)) >= 0) {
+		int i;
+
+		covered |= (1u << type);
+
+		uint64_t began = monotonic_us();
+
+		c->m_callType = type;
+		c->m_callStartUs = began;
+		c->m_callFailed = false;
+
+		for(i = 0; pollTable[i].m_type != type; i++);
+
+		result = pollTable[i].m_poll(c, dat, result);
+
+		c->m_callType = -1;
+
+		if((c->m_options & CUX_OPT_ADAPTIVE) && ! c->m_callFailed) {
+			int32_t values[SAMPLE_MAX_VALUES];
+			int count = sample_encode(dat, type, values);
+
+			sched_set_interval(&c->m_sched, type, adapt_update(&c->m_adapt[type], values, count, now));
+		}
+
+		sched_done(&c->m_sched, type, now, (uint32_t)(monotonic_us() - began));
+
+		// a failed call left the previous value behind
+		if(! c->m_callFailed) {
+			dat->m_sampled |= (1u << type);
+		}
 	}
 
-	if (is_due_for_measurement(SampleType_Throttle))
-	{
-		result = merge_result(result, c14cux_getThrottlePosition(&cuxinfo, m_throttlePosType, &(dat->m_throttlePos)));
+	sched_end_tick(&c->m_sched);
+
+	// the fuel map index changed the feedback mode this tick; the next tick polls for the new one
+	if(c->m_modeChanged) {
+		apply_feedback_mode(c, now);
+		c->m_modeChanges++;
 	}
 
-	if (is_due_for_measurement(SampleType_LambdaTrimShort))
-	{
-		result = merge_result(result, c14cux_getLambdaTrimShort(&cuxinfo, C14CUX_Bank_Odd, &(dat->m_lambdaTrimOdd)));
-		result = merge_result(result, c14cux_getLambdaTrimShort(&cuxinfo, C14CUX_Bank_Even, &(dat->m_lambdaTrimEven)));
+	faults = poll_faults(c, dat, now);
+
+	if(faults != readresult_nostatement) {
+		result = merge_result(c, result, faults == readresult_success);
 	}
 
-	if (is_due_for_measurement(SampleType_EngineRPM))
-	{
-		result = merge_result(result, c14cux_getEngineRPM(&cuxinfo, &(dat->m_engineSpeedRPM)));
-
-		// If we haven't yet reported the RPM limit, see if we can read it now.
-		// This is a special case because the limit is only read into its RAM
-		// location in the ECU once the main spark interrupt has run; we therefore
-		// wait until the engine speed > 0 before attempting this.
-		if (!dat->m_rpmLimitRead &&
-				(result == readresult_success) &&
-				(dat->m_engineSpeedRPM > 0) &&
-				c14cux_getRPMLimit(&cuxinfo, &(dat->m_rpmLimit)))
-		{
-			dat->m_rpmLimitRead = true;
+	// whatever serial time is left over goes to reading the ROM, if that is still running
+	rom = romcache_poll(&c->m_rom, &c->m_info, dat, rom_chunks(c));
+
+	if(rom != readresult_nostatement) {
+		result = merge_result(c, result, rom == readresult_success);
+	}
+
+	// nothing at all came back: after a few of those, close the port and start reconnecting
+	if((result != readresult_nostatement) && link_pass(&c->m_link, monotonic_us(), result == readresult_success, covered)) {
+		c14cux_disconnect(&c->m_info);
+	}
+
+	return result;
+}
+
+/*
+ * Reopen the port and ask for the tune revision, both to prove the ECU is
+ * answering and to tell whether it is the same one. If it is, everything
+ * learned so far (tune, rev limit, ROM image, fault codes) still holds and
+ * only the polls start again, all due at once. A different tune means a
+ * different ECU, so its per-ECU state is thrown away and read afresh.
+ */
+static bool reconnect(cux_conn* c, ecu_data* dat, uint64_t nowMs) {
+	uint16_t tune, ident;
+	uint8_t fixer;
+	uint32_t channels = 0;
+	int i;
+
+	// start from a fresh c14cux_info, as connect_to_ecu() does, so no addressing state carries over
+	c14cux_init(&c->m_info);
+
+	if(! c14cux_connect(&c->m_info, c->m_dev, C14CUX_BAUD)) {
+		link_attempt_failed(&c->m_link, monotonic_us());
+		return false;
+	}
+
+	if(! c14cux_getTuneRevision(&c->m_info, &tune, &fixer, &ident)) {
+		c14cux_disconnect(&c->m_info);
+		link_attempt_failed(&c->m_link, monotonic_us());
+		return false;
+	}
+
+	if(dat->m_readTuneId && ((tune != dat->m_tune) || (ident != dat->m_ident) || (fixer != dat->m_checksumFixer))) {
+		dat->m_readTuneId = false;
+		dat->m_rpmLimitRead = false;
+		dat->m_romRead = false;
+		dat->m_faultsRead = false;
+		memset(&dat->m_faultCodes, 0, sizeof(dat->m_faultCodes));
+		romcache_reset(&c->m_rom);
+	}
+
+	sched_restart(&c->m_sched, nowMs);
+	c->m_faultsDueMs = nowMs;
+
+	// channels the feedback mode leaves out are never read, so are not waited for
+	for(i = 0; i < POLL_TABLE_SIZE; i++) {
+		if(is_sample_appropriate_for_mode(c, pollTable[i].m_type)) {
+			channels |= (1u << pollTable[i].m_type);
 		}
 	}
 
-	if (is_due_for_measurement(SampleType_FuelMapRowCol))
-	{
-		result = merge_result(result, c14cux_getFuelMapRowIndex(&cuxinfo, &(dat->m_currentFuelMapRowIndex), &(dat->m_fuelMapRowWeighting)));
-		result = merge_result(result, c14cux_getFuelMapColumnIndex(&cuxinfo, &(dat->m_currentFuelMapColumnIndex), &(dat->m_fuelMapColWeighting)));
+	link_reconnected(&c->m_link, monotonic_us(), channels);
+
+	return true;
+}
+
+/*
+ * Fault codes live in RAM like everything else, but nobody needs them
+ * every tick: they are read once a FAULT_INTERVAL_MS, after the channels,
+ * if the tick still has room for them. A read that keeps being crowded out
+ * goes ahead anyway once a whole interval late. A failed read leaves the
+ * last good codes in place.
+ */
+static read_result poll_faults(cux_conn* c, ecu_data* dat, uint64_t nowMs) {
+	c14cux_faultcodes faults;
+
+	if(nowMs < c->m_faultsDueMs) {
+		return readresult_nostatement;
 	}
 
-	if (is_due_for_measurement(SampleType_InjectorPulseWidth))
-	{
-		result = merge_result(result, c14cux_getInjectorPulseWidth(&cuxinfo, &(dat->m_injectorPulseWidthUs)));
-		dat->m_injectorPulseWidthMs = (float)dat->m_injectorPulseWidthUs / 1000.0;
+	if((c->m_sched.m_spentUs + FAULT_COST_US > c->m_sched.m_budgetUs) && (nowMs < c->m_faultsDueMs + FAULT_INTERVAL_MS)) {
+		c->m_faultDeferrals++;
+		return readresult_nostatement;
 	}
 
-	if (is_due_for_measurement(SampleType_IdleBypassPosition))
-	{
-		result = merge_result(result, c14cux_getIdleBypassMotorPosition(&cuxinfo, &(dat->m_idleBypassPos)));
+	c->m_faultsDueMs = nowMs + FAULT_INTERVAL_MS;
+	c->m_faultReads++;
+
+	if(! c14cux_getFaultCodes(&c->m_info, &faults)) {
+		c->m_faultFailures++;
+		return readresult_failure;
 	}
 
-	if (is_due_for_measurement(SampleType_LambdaTrimLong))
-	{
-		result = merge_result(result, c14cux_getLambdaTrimLong(&cuxinfo, C14CUX_Bank_Odd, &(dat->m_lambdaTrimOdd)));
-		result = merge_result(result, c14cux_getLambdaTrimLong(&cuxinfo, C14CUX_Bank_Even, &(dat->m_lambdaTrimEven)));
+	dat->m_faultCodes = faults;
+	dat->m_faultsRead = true;
+
+	return readresult_success;
+}
+
+/*
+ * How many ROM reads this tick can take: as many of ROM_CHUNKS_PER_PASS
+ * image chunks, or the one fuel map, as fit in what is left of the serial
+ * budget. A ROM read crowded out for ROM_MAX_SKIPPED_PASSES passes in a row
+ * goes ahead anyway, so it still finishes on a link that is busy every tick.
+ */
+static int rom_chunks(cux_conn* c) {
+	rom_state state = romcache_state(&c->m_rom);
+	int most = (state == romstate_maps) ? 1 : ROM_CHUNKS_PER_PASS;
+	uint32_t cost = (state == romstate_maps) ? ROM_MAP_COST_US : ROM_CHUNK_COST_US;
+	int chunks = most;
+
+	if((state != romstate_dumping) && (state != romstate_maps)) {
+		return 0;
 	}
 
-	if (is_due_for_measurement(SampleType_MainVoltage))
-	{
-		result = merge_result(result, c14cux_getMainVoltage(&cuxinfo, &(dat->m_mainVoltage)));
+	while((chunks > 0) && (c->m_sched.m_spentUs + chunks * cost > c->m_sched.m_budgetUs)) {
+		chunks--;
 	}
 
-	if (is_due_for_measurement(SampleType_TargetIdleRPM))
-	{
-		result = merge_result(result, c14cux_getTargetIdle(&cuxinfo, &(dat->m_targetIdleSpeed)));
-		result = merge_result(result, c14cux_getIdleMode(&cuxinfo, &(dat->m_idleMode)));
+	if(chunks > 0) {
+		c->m_romSkippedPasses = 0;
+	}
+	else if(++c->m_romSkippedPasses >= ROM_MAX_SKIPPED_PASSES) {
+		c->m_romSkippedPasses = 0;
+		chunks = 1;
 	}
 
-	if (is_due_for_measurement(SampleType_FuelPumpRelay))
-	{
-		result = merge_result(result, c14cux_getFuelPumpRelayState(&cuxinfo, &(dat->m_fuelPumpRelayOn)));
+	c->m_romDeferrals += most - chunks;
+
+	return chunks;
+}
+
+static read_result poll_maf(cux_conn* c, ecu_data* dat, read_result result) {
+	float maf;
+
+	if(c14cux_getMAFReading(&c->m_info, c->m_airflowType, &maf)) {
+		dat->m_mafReading = from_float(maf, ECU_FRACTION_ONE);
+		return merge_result(c, result, true);
 	}
 
-	if (is_due_for_measurement(SampleType_GearSelection))
-	{
-		result = merge_result(result, c14cux_getGearSelection(&cuxinfo, &(dat->m_gear)));
+	return merge_result(c, result, false);
+}
+
+static read_result poll_throttle(cux_conn* c, ecu_data* dat, read_result result) {
+	float throttle;
+
+	if(c14cux_getThrottlePosition(&c->m_info, c->m_throttlePosType, &throttle)) {
+		dat->m_throttlePos = from_float(throttle, ECU_FRACTION_ONE);
+		return merge_result(c, result, true);
 	}
 
-	if (is_due_for_measurement(SampleType_RoadSpeed))
+	return merge_result(c, result, false);
+}
+
+static read_result poll_lambda_trim_short(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getLambdaTrimShort(&c->m_info, C14CUX_Bank_Odd, &(dat->m_lambdaTrimOdd)));
+	return merge_result(c, result, c14cux_getLambdaTrimShort(&c->m_info, C14CUX_Bank_Even, &(dat->m_lambdaTrimEven)));
+}
+
+static read_result poll_engine_rpm(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getEngineRPM(&c->m_info, &(dat->m_engineSpeedRPM)));
+
+	return read_rpm_limit(c, dat, result);
+}
+
+static read_result read_rpm_limit(cux_conn* c, ecu_data* dat, read_result result) {
+	// If we haven't yet reported the RPM limit, see if we can read it now.
+	// This is a special case because the limit is only read into its RAM
+	// location in the ECU once the main spark interrupt has run; we therefore
+	// wait until the engine speed > 0 before attempting this.
+	if (!dat->m_rpmLimitRead &&
+			(result == readresult_success) &&
+			(dat->m_engineSpeedRPM > 0) &&
+			c14cux_getRPMLimit(&c->m_info, &(dat->m_rpmLimit)))
 	{
-		result = merge_result(result, c14cux_getRoadSpeed(&cuxinfo, &(dat->m_roadSpeedMPH)));
+		dat->m_rpmLimitRead = true;
 	}
 
-	if (is_due_for_measurement(SampleType_EngineTemperature))
-	{
-		result = merge_result(result, c14cux_getCoolantTemp(&cuxinfo, &(dat->m_coolantTempF)));
+	return result;
+}
+
+static read_result poll_fuel_map_row_col(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getFuelMapRowIndex(&c->m_info, &(dat->m_currentFuelMapRowIndex), &(dat->m_fuelMapRowWeighting)));
+	return merge_result(c, result, c14cux_getFuelMapColumnIndex(&c->m_info, &(dat->m_currentFuelMapColumnIndex), &(dat->m_fuelMapColWeighting)));
+}
+
+static read_result poll_injector_pulse_width(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getInjectorPulseWidth(&c->m_info, &(dat->m_injectorPulseWidthUs)));
+	dat->m_injectorPulseWidthMs = ECU_REAL(dat->m_injectorPulseWidthUs, 1000, ECU_MS);
+	return result;
+}
+
+static read_result poll_idle_bypass(cux_conn* c, ecu_data* dat, read_result result) {
+	float pos;
+
+	if(c14cux_getIdleBypassMotorPosition(&c->m_info, &pos)) {
+		dat->m_idleBypassPos = from_float(pos, ECU_FRACTION_ONE);
+		return merge_result(c, result, true);
 	}
 
-	if (is_due_for_measurement(SampleType_FuelTemperature))
-	{
-		result = merge_result(result, c14cux_getFuelTemp(&cuxinfo, &(dat->m_fuelTempF)));
+	return merge_result(c, result, false);
+}
+
+static read_result poll_lambda_trim_long(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getLambdaTrimLong(&c->m_info, C14CUX_Bank_Odd, &(dat->m_lambdaTrimOdd)));
+	return merge_result(c, result, c14cux_getLambdaTrimLong(&c->m_info, C14CUX_Bank_Even, &(dat->m_lambdaTrimEven)));
+}
+
+static read_result poll_main_voltage(cux_conn* c, ecu_data* dat, read_result result) {
+	float volts;
+
+	if(c14cux_getMainVoltage(&c->m_info, &volts)) {
+		dat->m_mainVoltage = from_float(volts, ECU_VOLT);
+		return merge_result(c, result, true);
 	}
-/*
-	if (is_due_for_measurement(SampleType_FuelMapData))
+
+	return merge_result(c, result, false);
+}
+
+static read_result poll_target_idle(cux_conn* c, ecu_data* dat, read_result result) {
+	result = merge_result(c, result, c14cux_getTargetIdle(&c->m_info, &(dat->m_targetIdleSpeed)));
+	return merge_result(c, result, c14cux_getIdleMode(&c->m_info, &(dat->m_idleMode)));
+}
+
+static read_result poll_fuel_pump_relay(cux_conn* c, ecu_data* dat, read_result result) {
+	return merge_result(c, result, c14cux_getFuelPumpRelayState(&c->m_info, &(dat->m_fuelPumpRelayOn)));
+}
+
+static read_result poll_gear(cux_conn* c, ecu_data* dat, read_result result) {
+	return merge_result(c, result, c14cux_getGearSelection(&c->m_info, &(dat->m_gear)));
+}
+
+static read_result poll_road_speed(cux_conn* c, ecu_data* dat, read_result result) {
+	return merge_result(c, result, c14cux_getRoadSpeed(&c->m_info, &(dat->m_roadSpeedMPH)));
+}
+
+static read_result poll_engine_temp(cux_conn* c, ecu_data* dat, read_result result) {
+	return merge_result(c, result, c14cux_getCoolantTemp(&c->m_info, &(dat->m_coolantTempF)));
+}
+
+static read_result poll_fuel_temp(cux_conn* c, ecu_data* dat, read_result result) {
+	return merge_result(c, result, c14cux_getFuelTemp(&c->m_info, &(dat->m_fuelTempF)));
+}
+
+// Fuel map data is never polled: the maps are decoded from the cached ROM image (see romcache.c).
+
+// attempt to read the MIL status; if it can't be read, default it to off on the display
+static read_result poll_mil(cux_conn* c, ecu_data* dat, read_result result) {
+	if (c14cux_isMILOn(&c->m_info, &(dat->m_milOn)))
 	{
-		if (readFuelMap(m_currentFuelMapIndex))
-		{
-			emit fuelMapReady(m_currentFuelMapIndex);
-		}
+		result = merge_result(c, result, true);
 	}
-*/
-	// attempt to read the MIL status; if it can't be read, default it to off on the display
-	if (is_due_for_measurement(SampleType_MIL))
+	else
 	{
-		if (c14cux_isMILOn(&cuxinfo, &(dat->m_milOn)))
-		{
-			result = merge_result(result, true);
-		}
-		else
-		{
-			result = merge_result(result, false);
-			dat->m_milOn = false;
+		result = merge_result(c, result, false);
+		dat->m_milOn = false;
+	}
+
+	return result;
+}
+
+static read_result poll_co_trim(cux_conn* c, ecu_data* dat, read_result result) {
+	float volts;
+
+	if(c14cux_getCOTrimVoltage(&c->m_info, &volts)) {
+		dat->m_coTrimVoltage = from_float(volts, ECU_VOLT);
+		return merge_result(c, result, true);
+	}
+
+	return merge_result(c, result, false);
+}
+
+// A reading libcomm14cux scales itself, and so only hands back as a float, as an ecu_real in units of 1/one.
+static ecu_real from_float(float value, int32_t one) {
+#ifdef ROVERDISPLAY_FIXED_POINT
+	return (ecu_real)(value * one + 0.5);
+#else
+	return value;
+#endif
+}
+
+// The map cells themselves come from the ROM image; only the selection lives in RAM.
+static read_result poll_fuel_map_index(cux_conn* c, ecu_data* dat, read_result result) {
+	if(c14cux_getCurrentFuelMap(&c->m_info, &(dat->m_currentFuelMapIndex))) {
+		enum c14cux_feedback_mode mode = feedback_mode_for_map(dat->m_currentFuelMapIndex);
+
+		dat->m_fuelMapIndexRead = true;
+
+		if(mode != c->m_feedbackMode) {
+			c->m_feedbackMode = mode;
+			c->m_modeChanged = true;
 		}
+
+		return merge_result(c, result, true);
 	}
+
+	return merge_result(c, result, false);
+}
+
 /*
-	if (is_due_for_measurement(SampleType_FuelMapIndex))
-	{
-		uint8_t newFuelMapIndex = 0;
-		bool fuelMapIndexReadResult = c14cux_getCurrentFuelMap(&cuxinfo, &newFuelMapIndex);
-		result = merge_result(result, fuelMapIndexReadResult);
-
-		// do some processing that is only relevant if we successfully read the current map ID
-		if (fuelMapIndexReadResult)
-		{
-			// if the fuel map index has changed, or if this is the first time we've read it
-			if ((newFuelMapIndex != m_currentFuelMapIndex) || !m_fuelMapIndexRead)
-			{
-				m_currentFuelMapIndex = newFuelMapIndex;
-				emit fuelMapIndexHasChanged(m_currentFuelMapIndex);
-			}
+ * Take every channel the feedback mode makes meaningless out of the
+ * schedule, and put back any it makes meaningful again, due at once.
+ * Between ticks only.
+ */
+static void apply_feedback_mode(cux_conn* c, uint64_t nowMs) {
+	int i;
 
-			// regardless of whether the map has changed, we know now
-			// that is has been read at least once
-			m_fuelMapIndexRead = true;
+	for(i = 0; i < POLL_TABLE_SIZE; i++) {
+		SampleType type = pollTable[i].m_type;
 
-			// set the current fueling mode (open-loop or closed-loop)
-			c14cux_feedback_mode newFeedbackMode = C14CUX_FeedbackMode_ClosedLoop;
+		sched_set_enabled(&c->m_sched, type, is_sample_appropriate_for_mode(c, type), nowMs);
+	}
 
-			if ((m_currentFuelMapIndex >= s_firstOpenLoopMap) &&
-					(m_currentFuelMapIndex <= s_lastOpenLoopMap))
-			{
-				newFeedbackMode = C14CUX_FeedbackMode_OpenLoop;
-			}
+	c->m_modeChanged = false;
 
-			// if the feedback mode has changed, emit a signal
-			if (newFeedbackMode != m_feedbackMode)
-			{
-				m_feedbackMode = newFeedbackMode;
-				emit feedbackModeHasChanged(m_feedbackMode);
-			}
-		}
+}
+
+enum c14cux_feedback_mode feedback_mode_for_map(uint8_t map) {
+
+	if((map >= FUEL_MAP_FIRST_OPEN_LOOP) && (map <= FUEL_MAP_LAST_OPEN_LOOP)) {
+		return C14CUX_FeedbackMode_OpenLoop;
 	}
-*/	
-	if (is_due_for_measurement(SampleType_COTrimVoltage))
-	{
-		result = merge_result(result, c14cux_getCOTrimVoltage(&cuxinfo, &(dat->m_coTrimVoltage)));
+
+	return C14CUX_FeedbackMode_ClosedLoop;
+}
+
+const char* sample_type_name(SampleType type) {
+	return sampleTypeNames[type];
+}
+
+bool get_poll_stats(cux_conn* c, SampleType type, poll_stats* stats) {
+
+	if(! c->m_sched.m_channels[type].m_registered) {
+		return false;
 	}
 
-	return result;
+	sched_get_stats(&c->m_sched, type, (monotonic_us() - c->m_startUs) / 1000, stats);
+
+	return true;
+}
+
+void print_poll_stats(cux_conn* c, FILE* f) {
+	uint64_t now = (monotonic_us() - c->m_startUs) / 1000;
+	link_stats link;
+	int i;
+
+	fprintf(f, "%-20s %8s %8s %8s %8s %7s %8s\n", "Channel", "Interval", "Target", "Achieved", "Reads", "Misses", "MaxLate");
+
+	for(i = 0; i < POLL_TABLE_SIZE; i++) {
+		poll_stats st;
+		SampleType type = pollTable[i].m_type;
+
+		sched_get_stats(&c->m_sched, type, now, &st);
+
+		// anything shorter than the tick means "every tick"
+		float target = 1000.0 / ((st.m_intervalMs > POLL_PERIOD_MS) ? st.m_intervalMs : POLL_PERIOD_MS);
+
+		fprintf(f, "%-20s %6ums %6.2fHz %6.2fHz %8u %7u %6ums\n", sample_type_name(type), st.m_intervalMs, target, st.m_rateHz, st.m_reads, st.m_misses, st.m_maxLatenessMs);
+	}
+
+	fprintf(f, "%u ticks, %u over the %ums tick in serial time\n", c->m_sched.m_ticks, c->m_sched.m_overruns, c->m_sched.m_tickMs);
+	link_get_stats(&c->m_link, &link);
+	fprintf(f, "Link: %u drops, %u reconnect attempts", link.m_drops, link.m_attempts);
+
+	if(link.m_outage.m_count > 0) {
+		fprintf(f, ", outage p50 %.2fs max %.2fs, back to full rate p50 %.0fms max %.0fms", link.m_outage.m_p50Us / 1e6, link.m_outage.m_maxUs / 1e6, link.m_resync.m_p50Us / 1e3, link.m_resync.m_maxUs / 1e3);
+	}
+
+	fprintf(f, "\n");
+	fprintf(f, "Fault codes: %u reads, %u failed, %u deferred to a later tick\n", c->m_faultReads, c->m_faultFailures, c->m_faultDeferrals);
+	fprintf(f, "ROM: %u reads deferred to a later tick\n", c->m_romDeferrals);
+	fprintf(f, "Feedback: %s loop, %u changes\n", (c->m_feedbackMode == C14CUX_FeedbackMode_OpenLoop) ? "open" : "closed", c->m_modeChanges);
+
+}
+
+link_state get_link_state(cux_conn* c) {
+	return __atomic_load_n(&c->m_link.m_state, __ATOMIC_RELAXED);
 }
 
+void get_link_stats(cux_conn* c, link_stats* stats) {
+	link_get_stats(&c->m_link, stats);
+}
+
+const rom_cache* get_rom_cache(cux_conn* c) {
+	return &c->m_rom;
+}
+
+bool get_latency(cux_conn* c, SampleType type, latency_summary* sum) {
 
+	latency_summarise(&c->m_latency[type], sum);
 
+	return sum->m_count > 0;
+}
+
+void print_latency(cux_conn* c, FILE* f) {
+	int i;
+
+	for(i = 0; i < POLL_TABLE_SIZE; i++) {
+		latency_print(f, sample_type_name(pollTable[i].m_type), &c->m_latency[pollTable[i].m_type]);
+	}
+
+}
+
+// Rounded to the nearest km/h; a table lookup for anything a byte can hold.
 unsigned int convertSpeed(unsigned int speedMph, int speedUnits) {
-	float speed = (float)speedMph;
 
-	if (speedUnits == KPH) {
-		speed *= 1.609344;
+	if (speedUnits != KPH) {
+		return speedMph;
 	}
 
-	return (unsigned int)speed;
+	if (speedMph < UNITS_SPEED_COUNT) {
+		return unitsKphFromMph[speedMph];
+	}
+
+	// 1.609344 is exactly 25146 / 15625
+	return (speedMph * 25146 + 7812) / 15625;
 }
 
+// Rounded to the nearest degree, half away from zero as the tables are.
 int convertTemperature(int tempF, int tempUnits) {
-	double temp = tempF;
+	int scaled;
 
 	switch(tempUnits) {
   		case Celsius:
-    			temp = (temp - 32) * (0.5555556);
-    			break;
+			if((tempF >= UNITS_TEMP_MIN_F) && (tempF <= UNITS_TEMP_MAX_F)) {
+				return unitsCelsiusFromF[tempF - UNITS_TEMP_MIN_F];
+			}
+
+			scaled = (tempF - 32) * 5;
+			return (scaled < 0) ? -((-scaled + 4) / 9) : (scaled + 4) / 9;
 
 		case Fahrenheit:
 		default:
-    			break;
+    			return tempF;
   	}
 
-	return (int)temp;
+}
+
+// An ecu_real with unit 1/one as a whole number of 1/factor, rounded half away from zero; value * factor must fit 32 bits.
+int32_t ecu_scaled(ecu_real value, int32_t one, int32_t factor) {
+#ifdef ROVERDISPLAY_FIXED_POINT
+	int32_t scaled = value * factor;
+
+	return (scaled < 0 ? scaled - one / 2 : scaled + one / 2) / one;
+#else
+	float scaled = value * factor / one;
+
+	return (int32_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+#endif
+}
+
+// value / 10^decimals written out in full as %.Nf would, but from an integer; see ecu_scaled().
+const char* format_decimal(char* buf, size_t size, int32_t value, int decimals) {
+	uint32_t magnitude = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+	uint32_t divisor = 1;
+	int i;
+
+	// ten to the ninth is as far as 32 bits go
+	if(decimals > 9) {
+		decimals = 9;
+	}
+
+	for(i = 0; i < decimals; i++) {
+		divisor *= 10;
+	}
+
+	if(decimals > 0) {
+		snprintf(buf, size, "%s%u.%0*u", (value < 0) ? "-" : "", magnitude / divisor, decimals, magnitude % divisor);
+	}
+	else {
+		snprintf(buf, size, "%d", value);
+	}
+
+	return buf;
 }
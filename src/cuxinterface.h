@@ -1,13 +1,56 @@
 #ifndef CUXINTERFACE_H
 #define CUXINTERFACE_H
 
+#include <stdio.h>
 #include "comm14cux.h"
 #include "commonunits.h"
+#include "scheduler.h"
+#include "latency.h"
+#include "linkhealth.h"
 
 #define FUEL_MAP_COUNT 6
-#define FUEL_MAP_REFRESH false
+// Maps 1 to 3 are for engines without catalysts and run open loop; the others run closed loop on the lambda sensors.
+#define FUEL_MAP_FIRST_OPEN_LOOP	1
+#define FUEL_MAP_LAST_OPEN_LOOP		3
 
-c14cux_info cuxinfo;
+// Period at which read_data() is expected to be called.
+#define POLL_PERIOD_MS 200
+
+// How often the fault codes are read in the background, and what one read costs on the wire.
+#define FAULT_INTERVAL_MS	1000
+#define FAULT_COST_US		((SCHED_CMD_BYTES + 8) * SCHED_BYTE_US)
+
+// Options for connect_to_ecu().
+#define CUX_OPT_ADAPTIVE	0x02	// adapt poll intervals to how fast each channel is changing
+
+// One ECU link; see cuxconn.h.
+typedef struct cux_conn cux_conn;
+typedef struct rom_cache rom_cache;
+
+/*
+ * Analogue channels are held as ecu_real. That is a float, or with
+ * ROVERDISPLAY_FIXED_POINT an integer in the units samples.c encodes:
+ * fractions in parts per ECU_FRACTION_ONE, volts in millivolts and
+ * milliseconds in microseconds. Targets without an FPU turn every float
+ * operation into a library call, so the fixed-point build keeps the path
+ * to the screen in integers. Readings libcomm14cux only hands back as
+ * floats, with its own scaling, are converted once where they arrive.
+ * ECU_REAL() and ecu_scaled() read the same in both builds.
+ */
+#ifdef ROVERDISPLAY_FIXED_POINT
+typedef int32_t ecu_real;
+#define ECU_FRACTION_ONE	10000
+#define ECU_VOLT		1000
+#define ECU_MS			1000
+// num / den as an ecu_real whose unit is 1/one; truncated, so that the one rounding happens where it is shown
+#define ECU_REAL(num, den, one)	((int32_t)(num) * (one) / (den))
+#else
+typedef float ecu_real;
+#define ECU_FRACTION_ONE	1
+#define ECU_VOLT		1
+#define ECU_MS			1
+#define ECU_REAL(num, den, one)	((float)(num) * (one) / (den))
+#endif
 
 typedef enum read_result {
 	readresult_success,
@@ -15,11 +58,6 @@ typedef enum read_result {
 	readresult_nostatement
 	} read_result;
 
-enum c14cux_lambda_trim_type m_lambdaTrimType;
-enum c14cux_feedback_mode m_feedbackMode;
-enum c14cux_airflow_type m_airflowType;
-enum c14cux_throttle_pos_type m_throttlePosType;
-
 typedef struct ecu_data {
 	bool m_readTuneId;
 	bool m_rpmLimitRead;
@@ -28,39 +66,52 @@ typedef struct ecu_data {
 	uint16_t m_targetIdleSpeed;
 	int16_t m_coolantTempF;
 	int16_t m_fuelTempF;
-	float m_throttlePos;
+	ecu_real m_throttlePos;
 	enum c14cux_gear m_gear;
-	float m_mainVoltage;
+	ecu_real m_mainVoltage;
 	bool m_fuelMapIndexRead;
 	uint8_t m_currentFuelMapIndex;
 	uint8_t m_currentFuelMapRowIndex;
 	uint8_t m_fuelMapRowWeighting;
 	uint8_t m_currentFuelMapColumnIndex;
 	uint8_t m_fuelMapColWeighting;
-	float m_mafReading;
-	float m_idleBypassPos;
+	ecu_real m_mafReading;
+	ecu_real m_idleBypassPos;
 	bool m_fuelPumpRelayOn;
 	int16_t m_lambdaTrimOdd;
 	int16_t m_lambdaTrimEven;
-	float m_coTrimVoltage;
+	ecu_real m_coTrimVoltage;
 	bool m_milOn;
 	uint16_t m_rpmLimit;
 	bool m_idleMode;
 	uint16_t m_injectorPulseWidthUs;
-	float m_injectorPulseWidthMs;
+	ecu_real m_injectorPulseWidthMs;
 	uint16_t m_tune;
 	uint8_t m_checksumFixer;
 	uint16_t m_ident;
-	uint8_t m_rowScaler[FUEL_MAP_COUNT];
-	uint16_t m_mafScaler;
-	c14cux_faultcodes m_faultCodes;
+	bool m_romRead;
+	c14cux_faultcodes m_faultCodes;	// as of the last background read
+	bool m_faultsRead;
+	uint32_t m_sampled;
 	} ecu_data;
 
-extern bool connect_to_ecu(ecu_data* dat, const char* dev);
-extern void disconnect_from_ecu();
-extern read_result read_data(ecu_data* dat);
-extern read_result read_fault_codes(ecu_data* dat);
+extern cux_conn* connect_to_ecu(ecu_data* dat, const char* dev, unsigned int options);
+extern void disconnect_from_ecu(cux_conn* c);
+extern read_result read_data(cux_conn* c, ecu_data* dat);
+extern int fault_diff(const c14cux_faultcodes* before, const c14cux_faultcodes* now, c14cux_faultcodes* set);
+extern int fault_count(const c14cux_faultcodes* faults);
+extern const char* sample_type_name(SampleType type);
+extern enum c14cux_feedback_mode feedback_mode_for_map(uint8_t map);
+extern bool get_poll_stats(cux_conn* c, SampleType type, poll_stats* stats);
+extern void print_poll_stats(cux_conn* c, FILE* f);
+extern bool get_latency(cux_conn* c, SampleType type, latency_summary* sum);
+extern void print_latency(cux_conn* c, FILE* f);
+extern link_state get_link_state(cux_conn* c);
+extern void get_link_stats(cux_conn* c, link_stats* stats);
+extern const rom_cache* get_rom_cache(cux_conn* c);
 extern unsigned int convertSpeed(unsigned int speedMph, int speedUnits);
 extern int convertTemperature(int tempF, int tempUnits);
+extern int32_t ecu_scaled(ecu_real value, int32_t one, int32_t factor);
+extern const char* format_decimal(char* buf, size_t size, int32_t value, int decimals);
 
 #endif
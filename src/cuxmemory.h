@@ -0,0 +1,26 @@
+#ifndef CUXMEMORY_H
+#define CUXMEMORY_H
+
+/*
+ * 14CUX address space as seen over the diagnostic port, and where each
+ * entry comes from. Everything else is read through libcomm14cux, which
+ * keeps its own map; no RAM addresses are listed here because none could
+ * be taken from it.
+ *
+ * The tune ROM is a 16k 27C128 EPROM decoded into the top of the 6803's
+ * 64k space, which must hold the reset and interrupt vectors at
+ * 0xFFF0-0xFFFF; so it occupies 0xC000-0xFFFF. romcache.c reads it from
+ * there and checks the result against CUX_ROM_CHECKSUM, so a wrong base
+ * shows up as a dump that never checks out rather than as bad data.
+ */
+
+#define CUX_ROM_BASE			0xC000
+#define CUX_ROM_SIZE			0x4000
+// What the bytes of a tune ROM add up to, mod 256; the checksum fixer byte is chosen to make it so.
+#define CUX_ROM_CHECKSUM		0x01
+
+// The 128 cells c14cux_getFuelMap() fills, as rows of columns.
+#define CUX_FUEL_MAP_ROWS		8
+#define CUX_FUEL_MAP_COLUMNS		16
+
+#endif
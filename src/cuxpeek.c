@@ -0,0 +1,142 @@
+/*
+ * This file is part of the RoverDisplay distribution (https://github.com/draget/roverdisplay).
+ * Copyright (c) 2022 Thomas H. Drage.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * cuxpeek - reads the shared-memory table published by roverdisplay --shm
+ * and prints each channel's latest values, update count and age. With -b
+ * it instead reads every channel in a tight loop for a few seconds and
+ * reports how many reads it managed and how many were torn.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cuxinterface.h"
+#include "shmtable.h"
+
+#define BENCH_SECONDS	5
+
+void usage();
+void print_table(shm_table* t);
+void bench_table(shm_table* t);
+
+int main(int argc, char** argv) {
+	bool bench = false;
+	shm_table* t;
+	int opt;
+
+	while((opt = getopt(argc, argv, "b")) != -1) {
+		switch(opt) {
+			case 'b':
+				bench = true;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if(optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	t = shmtable_attach(argv[optind]);
+
+	if(! t) {
+		fprintf(stderr, "No roverdisplay table at %s.\n", argv[optind]);
+		return 1;
+	}
+
+	if(bench) {
+		bench_table(t);
+	}
+	else {
+		print_table(t);
+	}
+
+	shmtable_close(t);
+
+	return 0;
+}
+
+void usage() {
+	fprintf(stderr, "Usage: cuxpeek [-b] <name>, e.g. cuxpeek /roverdisplay\n");
+}
+
+void print_table(shm_table* t) {
+	uint64_t now = wallclock_ms();
+	int type;
+
+	printf("Writer last active %llums ago\n", (unsigned long long)(now - shmtable_heartbeat(t)));
+	printf("%-20s %8s %8s %10s\n", "Channel", "Updates", "Age", "Values");
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		shm_sample s;
+		int i;
+
+		if(sample_value_count(type) == 0) {
+			continue;
+		}
+
+		switch(shmtable_read(t, type, &s)) {
+			case shmread_never:
+				printf("%-20s %8s\n", sample_type_name(type), "-");
+				break;
+			case shmread_torn:
+				printf("%-20s %8s\n", sample_type_name(type), "torn");
+				break;
+			case shmread_ok:
+				printf("%-20s %8u %6llums", sample_type_name(type), s.m_seq, (unsigned long long)(now - s.m_timeMs));
+
+				for(i = 0; i < sample_value_count(type); i++) {
+					printf(" %10d", s.m_values[i]);
+				}
+
+				printf("\n");
+				break;
+		}
+	}
+
+}
+
+void bench_table(shm_table* t) {
+	uint64_t start = monotonic_us();
+	uint64_t elapsed;
+	unsigned long reads = 0;
+	unsigned long torn = 0;
+
+	do {
+		int type;
+
+		for(type = 0; type < SampleType_NumSampleTypes; type++) {
+			shm_sample s;
+
+			if(shmtable_read(t, type, &s) == shmread_torn) {
+				torn++;
+			}
+
+			reads++;
+		}
+
+		elapsed = monotonic_us() - start;
+	} while(elapsed < BENCH_SECONDS * 1000000ULL);
+
+	printf("%lu channel reads in %us (%.0f ns each), %lu torn\n", reads, BENCH_SECONDS, elapsed * 1000.0 / reads, torn);
+
+}
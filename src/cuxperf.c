@@ -0,0 +1,352 @@
+/*
+ * This file is part of the RoverDisplay distribution (https://github.com/draget/roverdisplay).
+ * Copyright (c) 2022 Thomas H. Drage.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * cuxperf - times the display's hot paths without an ECU or a terminal:
+ * a main screen update through the render layer into a fake vt100 on
+ * /dev/null, a whole display tick (derived channels, history and screen),
+ * the unit conversions and appending to a session log. Each case
+ * reports time per operation and, where the kernel will count them,
+ * instructions per operation. Under qemu-user there is no counter, so
+ * perf/perfcheck.sh runs one case per process and counts with a qemu plugin
+ * instead; the "none" case measures the start-up that has to be subtracted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "cuxinterface.h"
+#include "sessionlog.h"
+#include "derived.h"
+#include "history.h"
+#include "render.h"
+
+#define DEFAULT_REPEATS	3
+
+typedef struct perf_case {
+	const char* m_name;
+	unsigned int m_iterations;
+	void (*m_run)(unsigned int iterations);
+	} perf_case;
+
+void usage();
+void run_case(const perf_case* pc, unsigned int iterations, unsigned int repeats, FILE* out);
+int open_counter();
+void run_none(unsigned int iterations);
+void run_render(unsigned int iterations);
+void run_frame(unsigned int iterations);
+void run_convert(unsigned int iterations);
+void run_log(unsigned int iterations);
+void start_render();
+void draw(const ecu_data* dat, ecu_real duty);
+void vary(ecu_data* dat, unsigned int i);
+
+const perf_case cases[] = {
+	{ "none",    1,      run_none },
+	{ "render",  5000,   run_render },
+	{ "frame",   5000,   run_frame },
+	{ "convert", 200000, run_convert },
+	{ "log",     50000,  run_log }
+	};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+// keeps results live so the work cannot be optimised away
+volatile uint32_t sink;
+bool rendering;
+
+int main(int argc, char** argv) {
+	unsigned int iterations = 0;
+	unsigned int repeats = DEFAULT_REPEATS;
+	FILE* out;
+	int opt;
+	int i, j;
+
+	while((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch(opt) {
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 'r':
+				repeats = atoi(optarg);
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if(repeats == 0) {
+		usage();
+		return 1;
+	}
+
+	// results go to the real stdout; curses gets /dev/null in its place
+	out = fdopen(dup(STDOUT_FILENO), "w");
+
+	if(! out || ! freopen("/dev/null", "w", stdout)) {
+		perror("cuxperf");
+		return 1;
+	}
+
+	fprintf(out, "%-10s %10s %12s %12s\n", "Case", "Iterations", "ns/op", "insns/op");
+
+	for(i = optind; i < argc; i++) {
+		for(j = 0; (j < CASE_COUNT) && (strcmp(argv[i], cases[j].m_name) != 0); j++);
+
+		if(j == CASE_COUNT) {
+			usage();
+			return 1;
+		}
+	}
+
+	for(j = 0; j < CASE_COUNT; j++) {
+		bool wanted = (optind == argc);
+
+		for(i = optind; i < argc; i++) {
+			wanted |= (strcmp(argv[i], cases[j].m_name) == 0);
+		}
+
+		if(wanted) {
+			run_case(&cases[j], iterations ? iterations : cases[j].m_iterations, repeats, out);
+		}
+	}
+
+	if(rendering) {
+		render_end();
+	}
+
+	fclose(out);
+
+	return 0;
+}
+
+void usage() {
+
+	fprintf(stderr, "Usage: cuxperf [-n iterations] [-r repeats] [case ...]\n"
+			"Cases: none render frame convert log (default: all)\n");
+
+}
+
+// Best of several runs, since anything else on the machine only ever adds time.
+void run_case(const perf_case* pc, unsigned int iterations, unsigned int repeats, FILE* out) {
+	uint64_t bestUs = UINT64_MAX;
+	long long insns = -1;
+	int counter = open_counter();
+	unsigned int r;
+
+	for(r = 0; r < repeats; r++) {
+		uint64_t began = monotonic_us();
+		long long count;
+
+		if(counter >= 0) {
+			ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+		}
+
+		pc->m_run(iterations);
+
+		if(counter >= 0) {
+			ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+
+			if((read(counter, &count, sizeof(count)) == sizeof(count)) && ((insns < 0) || (count < insns))) {
+				insns = count;
+			}
+		}
+
+		if(monotonic_us() - began < bestUs) {
+			bestUs = monotonic_us() - began;
+		}
+	}
+
+	if(counter >= 0) {
+		close(counter);
+	}
+
+	fprintf(out, "%-10s %10u %12.1f ", pc->m_name, iterations, bestUs * 1000.0 / iterations);
+
+	if(insns >= 0) {
+		fprintf(out, "%12.1f\n", (double)insns / iterations);
+	}
+	else {
+		fprintf(out, "%12s\n", "-");
+	}
+
+	fflush(out);
+
+}
+
+// User-space instructions retired by this thread, or -1 where there is no counter (VMs, qemu-user).
+int open_counter() {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void run_none(unsigned int iterations) {
+}
+
+// The main screen's fields as update_data() draws them, with the values moving every pass.
+void run_render(unsigned int iterations) {
+	ecu_data dat;
+	unsigned int i;
+
+	start_render();
+	memset(&dat, 0, sizeof(dat));
+
+	for(i = 0; i < iterations; i++) {
+		vary(&dat, i);
+		draw(&dat, duty_cycle(dat.m_injectorPulseWidthMs, dat.m_engineSpeedRPM));
+		render_flush();
+	}
+
+}
+
+// One whole display tick: the derived channels and history fed, and the screen drawn.
+void run_frame(unsigned int iterations) {
+	static history hist;
+	static derived_state derived;
+	derived_summary sums[derived_count];
+	ecu_data dat;
+	unsigned int i;
+
+	start_render();
+	memset(&dat, 0, sizeof(dat));
+	history_init(&hist, 0);
+	derived_init(&derived, DERIVED_WINDOW_MS, 0);
+
+	for(i = 0; i < iterations; i++) {
+		vary(&dat, i);
+		dat.m_sampled = (1u << SampleType_NumSampleTypes) - 1;
+		derived_update(&derived, (uint64_t)i * POLL_PERIOD_MS, &dat);
+		history_add(&hist, (uint64_t)i * POLL_PERIOD_MS, &dat);
+		derived_summarise(&derived, sums);
+		draw(&dat, sums[derived_dutycycle].m_value);
+		render_flush();
+	}
+
+}
+
+void start_render() {
+
+	if(! rendering) {
+		setenv("TERM", "vt100", 1);
+		setenv("LINES", "24", 1);
+		setenv("COLUMNS", "80", 1);
+		rendering = render_begin(false);
+	}
+
+	render_invalidate();
+
+}
+
+void draw(const ecu_data* dat, ecu_real duty) {
+	char num[16];
+	int row = 1;
+
+	render_field(0, row++, 25, dat->m_milOn ? RENDER_REVERSE : RENDER_NORMAL, "%-6s", dat->m_milOn ? "On" : "Off");
+	render_field(1, row, 25, RENDER_NORMAL, "%-6u", dat->m_engineSpeedRPM);
+	render_field(2, row++, 65, RENDER_NORMAL, "%-6d", convertTemperature(dat->m_coolantTempF, Celsius));
+	render_field(3, row, 25, RENDER_NORMAL, "%-6u", convertSpeed(dat->m_roadSpeedMPH, KPH));
+	render_field(4, row++, 65, RENDER_NORMAL, "%-6d", convertTemperature(dat->m_fuelTempF, Celsius));
+	row++;
+	render_field(5, row++, 25, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(dat->m_mafReading, ECU_FRACTION_ONE, 1000), 1));
+	render_field(6, row, 25, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(dat->m_throttlePos, ECU_FRACTION_ONE, 1000), 1));
+	render_field(7, row++, 65, RENDER_NORMAL, "%-6u", dat->m_rpmLimit);
+	render_field(8, row, 25, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(dat->m_idleBypassPos, ECU_FRACTION_ONE, 1000), 1));
+	render_field(9, row++, 65, dat->m_idleMode ? RENDER_REVERSE : RENDER_NORMAL, "%-6u", dat->m_targetIdleSpeed);
+	row++;
+	render_field(10, row, 25, RENDER_NORMAL, "%-6d", dat->m_lambdaTrimOdd);
+	render_field(11, row++, 65, RENDER_NORMAL, "%-6d", dat->m_lambdaTrimEven);
+	render_field(12, row, 25, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(duty, DERIVED_ONE, 10), 1));
+	render_field(13, row++, 65, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(dat->m_injectorPulseWidthMs, ECU_MS, 100), 2));
+	render_field(14, row, 25, RENDER_NORMAL, "%-6s", format_decimal(num, sizeof(num), ecu_scaled(dat->m_mainVoltage, ECU_VOLT, 100), 2));
+	render_field(15, row++, 65, dat->m_fuelPumpRelayOn ? RENDER_REVERSE : RENDER_NORMAL, "%-6s", dat->m_fuelPumpRelayOn ? "On" : "Off");
+
+}
+
+void run_convert(unsigned int iterations) {
+	unsigned int i;
+
+	for(i = 0; i < iterations; i++) {
+		sink += convertSpeed(i & 0xff, KPH);
+		sink += convertTemperature((int)(i % 300) - 40, Celsius);
+		sink += (uint32_t)duty_cycle(ECU_REAL(i % 20000, 1000, ECU_MS), i % 6000);
+	}
+
+}
+
+// Every channel sampled every pass, appended to a log that goes nowhere.
+void run_log(unsigned int iterations) {
+	session_log* log = sessionlog_open_fd(open("/dev/null", O_WRONLY), 0);
+	ecu_data dat;
+	unsigned int i;
+
+	if(! log) {
+		return;
+	}
+
+	memset(&dat, 0, sizeof(dat));
+
+	for(i = 0; i < iterations; i++) {
+		vary(&dat, i);
+		sessionlog_append(log, (uint64_t)i * 25, &dat, (1u << SampleType_NumSampleTypes) - 1);
+	}
+
+	sessionlog_close(log);
+
+}
+
+// Plausible engine values that move a little every pass, as a running engine's do.
+void vary(ecu_data* dat, unsigned int i) {
+	unsigned int load = i % 200;
+
+	dat->m_engineSpeedRPM = 750 + load * 16;
+	dat->m_roadSpeedMPH = load / 3;
+	dat->m_coolantTempF = 190 + (i / 500) % 20;
+	dat->m_fuelTempF = 100 + (i / 900) % 10;
+	dat->m_mafReading = ECU_REAL(load, 250, ECU_FRACTION_ONE);
+	dat->m_throttlePos = ECU_REAL(load, 220, ECU_FRACTION_ONE);
+	dat->m_idleBypassPos = ECU_REAL(200 - load, 400, ECU_FRACTION_ONE);
+	dat->m_idleMode = (load < 5);
+	dat->m_targetIdleSpeed = 700;
+	dat->m_rpmLimit = 5700;
+	dat->m_lambdaTrimOdd = (int)(i % 41) - 20;
+	dat->m_lambdaTrimEven = (int)((i + 7) % 41) - 20;
+	dat->m_injectorPulseWidthUs = 2200 + load * 30;
+	dat->m_injectorPulseWidthMs = ECU_REAL(dat->m_injectorPulseWidthUs, 1000, ECU_MS);
+	dat->m_mainVoltage = ECU_REAL(1380 + i % 5, 100, ECU_VOLT);
+	dat->m_fuelPumpRelayOn = true;
+	dat->m_milOn = (i / 1000) & 1;
+	dat->m_currentFuelMapRowIndex = load / 13;
+	dat->m_currentFuelMapColumnIndex = load / 25;
+
+}
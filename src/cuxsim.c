@@ -0,0 +1,305 @@
+/*
+ * This file is part of the RoverDisplay distribution (https://github.com/draget/roverdisplay).
+ * Copyright (c) 2022 Thomas H. Drage.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * cuxsim - a 14CUX stand-in on a pseudo-terminal.
+ *
+ * Serves reads from a 64k memory image using the diagnostic port protocol:
+ * the host sends the coarse (high) and fine (low) address bytes, each of
+ * which the ECU echoes, then a count byte; the ECU answers with that many
+ * bytes starting at the address. Every byte in either direction is delayed
+ * by one character time at the configured baud rate.
+ *
+ * The built-in image is pseudo-random rather than laid out from
+ * cuxmemory.h, so a client reads the same bytes whatever addresses it
+ * believes in. Only the placement of the ROM is assumed:
+ * the top 16k, whose bytes are made to add up to SIM_ROM_CHECKSUM as a
+ * tune ROM's do. For realistic values, load images dumped from an ECU.
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <time.h>
+
+#define DEFAULT_BAUD	7812
+#define ANIMATE_MS	50
+
+#define SIM_MEMORY_SIZE	0x10000
+#define SIM_ROM_BASE	0xC000
+#define SIM_ROM_SIZE	0x4000
+#define SIM_ROM_CHECKSUM	0x01
+#define SIM_SEED	0x14C0u
+
+// -d moves every RAM byte up to SIM_SWING either side of its loaded value, over SIM_PERIOD steps.
+#define SIM_SWING	8
+#define SIM_PERIOD	(4 * SIM_SWING)
+
+typedef enum sim_state {
+	state_coarse,
+	state_fine,
+	state_count
+	} sim_state;
+
+void usage();
+bool load_image(const char* path, uint16_t base, uint16_t len);
+void default_image();
+void animate(unsigned int step);
+void send_byte(int fd, uint8_t b);
+void exit_handler(int signum);
+
+uint8_t mem[SIM_MEMORY_SIZE];
+uint8_t ram[SIM_ROM_BASE];	// RAM as loaded, which -d animates around
+unsigned int byteUs;
+volatile sig_atomic_t run;
+
+int main(int argc, char** argv) {
+	const char* romPath = NULL;
+	const char* ramPath = NULL;
+	const char* linkPath = NULL;
+	unsigned int baud = DEFAULT_BAUD;
+	bool dynamic = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "r:m:l:b:d")) != -1) {
+		switch(opt) {
+			case 'r':
+				romPath = optarg;
+				break;
+			case 'm':
+				ramPath = optarg;
+				break;
+			case 'l':
+				linkPath = optarg;
+				break;
+			case 'b':
+				baud = atoi(optarg);
+				break;
+			case 'd':
+				dynamic = true;
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if(baud == 0) {
+		usage();
+		return 1;
+	}
+
+	// 8N1: a start bit, eight data bits and a stop bit per character
+	byteUs = 10 * 1000000 / baud;
+
+	default_image();
+
+	if(ramPath && ! load_image(ramPath, 0, SIM_ROM_BASE)) {
+		return 1;
+	}
+
+	if(romPath && ! load_image(romPath, SIM_ROM_BASE, SIM_ROM_SIZE)) {
+		return 1;
+	}
+
+	memcpy(ram, mem, sizeof(ram));
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+		perror("Couldn't allocate a pseudo-terminal");
+		return 1;
+	}
+
+	const char* slaveName = ptsname(master);
+
+	// hold the slave open so the master doesn't see a hangup between clients
+	int slave = open(slaveName, O_RDWR | O_NOCTTY);
+	struct termios tio;
+
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+
+	if(linkPath) {
+		unlink(linkPath);
+
+		if(symlink(slaveName, linkPath) != 0) {
+			perror("Couldn't create link to pseudo-terminal");
+			return 1;
+		}
+	}
+
+	printf("cuxsim: serving on %s at %u baud%s\n", linkPath ? linkPath : slaveName, baud, dynamic ? " (animated)" : "");
+	fflush(stdout);
+
+	signal(SIGINT, exit_handler);
+	signal(SIGTERM, exit_handler);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	sim_state state = state_coarse;
+	uint16_t addr = 0;
+	run = 1;
+
+	while(run) {
+		fd_set fds;
+		struct timeval tv = { 0, ANIMATE_MS * 1000 };
+		uint8_t b;
+
+		FD_ZERO(&fds);
+		FD_SET(master, &fds);
+
+		if(dynamic) {
+			struct timespec now;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			animate(((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000) / ANIMATE_MS);
+		}
+
+		if(select(master + 1, &fds, NULL, NULL, &tv) <= 0) {
+			continue;
+		}
+
+		if(read(master, &b, 1) != 1) {
+			continue;
+		}
+
+		// the byte took a character time to arrive
+		usleep(byteUs);
+
+		switch(state) {
+			case state_coarse:
+				addr = (uint16_t)b << 8;
+				send_byte(master, b);
+				state = state_fine;
+				break;
+			case state_fine:
+				addr |= b;
+				send_byte(master, b);
+				state = state_count;
+				break;
+			case state_count: {
+				unsigned int i;
+
+				for(i = 0; i < b; i++) {
+					send_byte(master, mem[(uint16_t)(addr + i)]);
+				}
+
+				state = state_coarse;
+				break;
+			}
+		}
+	}
+
+	if(linkPath) {
+		unlink(linkPath);
+	}
+
+	close(slave);
+	close(master);
+
+	return 0;
+}
+
+void usage() {
+	fprintf(stderr, "Usage: cuxsim [-r rom.bin] [-m ram.bin] [-l link] [-b baud] [-d]\n"
+			"  -r  16k ROM image loaded at 0x%04X\n"
+			"  -m  RAM image loaded at 0x0000\n"
+			"  -l  symlink to create pointing at the pty, e.g. /tmp/ttyCUX\n"
+			"  -b  baud rate used to pace each byte (default %u)\n"
+			"  -d  keep every RAM byte moving\n", SIM_ROM_BASE, DEFAULT_BAUD);
+}
+
+bool load_image(const char* path, uint16_t base, uint16_t len) {
+	FILE* f = fopen(path, "rb");
+
+	if(! f) {
+		perror(path);
+		return false;
+	}
+
+	size_t got = fread(&mem[base], 1, len, f);
+	fclose(f);
+
+	if(got == 0) {
+		fprintf(stderr, "%s: empty image\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+void default_image() {
+	uint32_t x = SIM_SEED;
+	uint8_t sum = 0;
+	unsigned int i;
+
+	// xorshift32, so every run serves the same image
+	for(i = 0; i < SIM_MEMORY_SIZE; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		mem[i] = x >> 24;
+	}
+
+	for(i = 1; i < SIM_ROM_SIZE; i++) {
+		sum += mem[SIM_ROM_BASE + i];
+	}
+
+	mem[SIM_ROM_BASE] = SIM_ROM_CHECKSUM - sum;
+}
+
+// A triangle wave per byte, each out of step with its neighbours.
+void animate(unsigned int step) {
+	static unsigned int last = ~0u;
+	unsigned int i;
+
+	if(step == last) {
+		return;
+	}
+
+	last = step;
+
+	for(i = 0; i < SIM_ROM_BASE; i++) {
+		int phase = (step + i * 7) % SIM_PERIOD;
+		int offset = (phase < SIM_PERIOD / 2) ? phase - SIM_SWING : 3 * SIM_SWING - phase;
+
+		mem[i] = ram[i] + offset;
+	}
+}
+
+void send_byte(int fd, uint8_t b) {
+	if(write(fd, &b, 1) == 1) {
+		usleep(byteUs);
+	}
+}
+
+void exit_handler(int signum) {
+	run = 0;
+}
@@ -0,0 +1,169 @@
+#include <string.h>
+#include "derived.h"
+
+static void push(rolling_stat* r, uint32_t timeMs, ecu_real value, uint32_t windowMs);
+static void evict(rolling_stat* r);
+static void set(derived_state* d, derived_channel ch, uint32_t timeMs, ecu_real value);
+
+#define SLOT(pos)	((pos) & (ROLLING_CAPACITY - 1))
+
+static const char* const derivedNames[derived_count] = {
+	[derived_dutycycle]   = "Injector duty cycle",
+	[derived_fuelflow]    = "Fuel flow",
+	[derived_lambdatrim]  = "Lambda trim (avg)",
+	[derived_rpm]         = "Engine speed",
+	[derived_roadspeed]   = "Road speed",
+	[derived_maf]         = "MAF",
+	[derived_throttle]    = "Throttle",
+	[derived_mainvoltage] = "Main voltage"
+	};
+
+void derived_init(derived_state* d, uint32_t windowMs, uint64_t startMs) {
+
+	memset(d, 0, sizeof(*d));
+	// a zero window would evict the sample being added
+	d->m_windowMs = windowMs ? windowMs : 1;
+	d->m_startMs = startMs;
+
+}
+
+void derived_update(derived_state* d, uint64_t timeMs, const ecu_data* dat) {
+	uint32_t t = timeMs - d->m_startMs;
+	uint32_t sampled = dat->m_sampled;
+
+	if(sampled & ((1u << SampleType_InjectorPulseWidth) | (1u << SampleType_EngineRPM))) {
+		ecu_real duty = duty_cycle(dat->m_injectorPulseWidthMs, dat->m_engineSpeedRPM);
+
+		set(d, derived_dutycycle, t, duty);
+		// percent of the injectors' cc/min, in l/h
+		set(d, derived_fuelflow, t, ECU_REAL(duty * DERIVED_INJECTORS * DERIVED_INJECTOR_CC_MIN * 6, 10000, 1));
+	}
+
+	if(sampled & ((1u << SampleType_LambdaTrimShort) | (1u << SampleType_LambdaTrimLong))) {
+		set(d, derived_lambdatrim, t, (dat->m_lambdaTrimOdd + dat->m_lambdaTrimEven) * DERIVED_ONE / (ecu_real)2);
+	}
+
+	if(sampled & (1u << SampleType_EngineRPM)) {
+		set(d, derived_rpm, t, dat->m_engineSpeedRPM * DERIVED_ONE);
+	}
+
+	if(sampled & (1u << SampleType_RoadSpeed)) {
+		set(d, derived_roadspeed, t, dat->m_roadSpeedMPH * DERIVED_ONE);
+	}
+
+	if(sampled & (1u << SampleType_MAF)) {
+		set(d, derived_maf, t, ECU_REAL(dat->m_mafReading, ECU_FRACTION_ONE, 100 * DERIVED_ONE));
+	}
+
+	if(sampled & (1u << SampleType_Throttle)) {
+		set(d, derived_throttle, t, ECU_REAL(dat->m_throttlePos, ECU_FRACTION_ONE, 100 * DERIVED_ONE));
+	}
+
+	if(sampled & (1u << SampleType_MainVoltage)) {
+		set(d, derived_mainvoltage, t, ECU_REAL(dat->m_mainVoltage, ECU_VOLT, DERIVED_ONE));
+	}
+
+}
+
+void derived_reset_peaks(derived_state* d) {
+	int i;
+
+	for(i = 0; i < derived_count; i++) {
+		d->m_channel[i].m_peak = d->m_channel[i].m_value;
+	}
+
+}
+
+void derived_summarise(const derived_state* d, derived_summary* sums) {
+	int i;
+
+	for(i = 0; i < derived_count; i++) {
+		const derived_value* v = &d->m_channel[i];
+		const rolling_stat* r = &v->m_window;
+
+		sums[i].m_valid = v->m_valid;
+
+		if(v->m_valid) {
+			sums[i].m_value = v->m_value;
+			sums[i].m_peak = v->m_peak;
+			sums[i].m_min = r->m_value[SLOT(r->m_minq[SLOT(r->m_minHead)])];
+			sums[i].m_max = r->m_value[SLOT(r->m_maxq[SLOT(r->m_maxHead)])];
+			sums[i].m_mean = r->m_sum / (r->m_next - r->m_first);
+		}
+	}
+
+}
+
+const char* derived_name(derived_channel ch) {
+	return derivedNames[ch];
+}
+
+// Percentage of each revolution the injectors are open, in DERIVED_ONE units; nothing is open with the engine stopped.
+ecu_real duty_cycle(ecu_real pulseWidthMs, unsigned int rpm) {
+
+	if(rpm == 0) {
+		return 0;
+	}
+
+	return ECU_REAL(pulseWidthMs * rpm, 600 * ECU_MS / DERIVED_ONE, 1);
+}
+
+static void set(derived_state* d, derived_channel ch, uint32_t timeMs, ecu_real value) {
+	derived_value* v = &d->m_channel[ch];
+
+	if(! v->m_valid || (value > v->m_peak)) {
+		v->m_peak = value;
+	}
+
+	v->m_value = value;
+	v->m_valid = true;
+	push(&v->m_window, timeMs, value, d->m_windowMs);
+
+}
+
+static void push(rolling_stat* r, uint32_t timeMs, ecu_real value, uint32_t windowMs) {
+
+	if(r->m_next - r->m_first == ROLLING_CAPACITY) {
+		evict(r);
+	}
+
+	r->m_timeMs[SLOT(r->m_next)] = timeMs;
+	r->m_value[SLOT(r->m_next)] = value;
+	r->m_sum += value;
+
+	// anything the new value outlasts and beats can never be the min (max) again
+	while((r->m_minTail != r->m_minHead) && (r->m_value[SLOT(r->m_minq[SLOT(r->m_minTail - 1)])] >= value)) {
+		r->m_minTail--;
+	}
+
+	r->m_minq[SLOT(r->m_minTail++)] = r->m_next;
+
+	while((r->m_maxTail != r->m_maxHead) && (r->m_value[SLOT(r->m_maxq[SLOT(r->m_maxTail - 1)])] <= value)) {
+		r->m_maxTail--;
+	}
+
+	r->m_maxq[SLOT(r->m_maxTail++)] = r->m_next;
+	r->m_next++;
+
+	// never evict the sample just pushed, even if the clock stepped back
+	while((r->m_first != r->m_next - 1) && (timeMs - r->m_timeMs[SLOT(r->m_first)] >= windowMs)) {
+		evict(r);
+	}
+
+}
+
+static void evict(rolling_stat* r) {
+
+	r->m_sum -= r->m_value[SLOT(r->m_first)];
+
+	if(r->m_minq[SLOT(r->m_minHead)] == r->m_first) {
+		r->m_minHead++;
+	}
+
+	if(r->m_maxq[SLOT(r->m_maxHead)] == r->m_first) {
+		r->m_maxHead++;
+	}
+
+	r->m_first++;
+
+}
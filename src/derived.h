@@ -0,0 +1,86 @@
+#ifndef DERIVED_H
+#define DERIVED_H
+
+#include "cuxinterface.h"
+
+/*
+ * Derived channels, updated whenever a pass delivers one of their inputs.
+ * Each keeps its latest value, a peak hold (until derived_reset_peaks()),
+ * and min/max/mean over a rolling time window. The window is a
+ * preallocated ring with two monotonic deques of ring positions, so an
+ * update costs amortised O(1): every sample is pushed and popped at most
+ * once. Should more than ROLLING_CAPACITY samples fall inside the window,
+ * the oldest go early.
+ */
+
+#define ROLLING_CAPACITY	512	// a power of two, so positions may wrap
+#define DERIVED_WINDOW_MS	5000
+
+// Values are ecu_reals; in the fixed-point build they count hundredths.
+#ifdef ROVERDISPLAY_FIXED_POINT
+#define DERIVED_ONE		100
+typedef int64_t derived_sum;
+#else
+#define DERIVED_ONE		1
+typedef double derived_sum;
+#endif
+
+// Fuel flow estimate: eight injectors fired once per revolution.
+#define DERIVED_INJECTORS	8
+#define DERIVED_INJECTOR_CC_MIN	190
+
+typedef enum derived_channel {
+	derived_dutycycle,	// %
+	derived_fuelflow,	// l/h
+	derived_lambdatrim,	// mean of both banks, in ECU counts
+	derived_rpm,
+	derived_roadspeed,	// mph
+	derived_maf,		// %
+	derived_throttle,	// %
+	derived_mainvoltage,
+	derived_count
+	} derived_channel;
+
+typedef struct rolling_stat {
+	uint32_t m_timeMs[ROLLING_CAPACITY];
+	ecu_real m_value[ROLLING_CAPACITY];
+	uint32_t m_first;	// position of the oldest sample still in the window
+	uint32_t m_next;
+	uint32_t m_minq[ROLLING_CAPACITY];
+	uint32_t m_minHead, m_minTail;
+	uint32_t m_maxq[ROLLING_CAPACITY];
+	uint32_t m_maxHead, m_maxTail;
+	derived_sum m_sum;
+	} rolling_stat;
+
+typedef struct derived_value {
+	bool m_valid;
+	ecu_real m_value;
+	ecu_real m_peak;
+	rolling_stat m_window;
+	} derived_value;
+
+typedef struct derived_state {
+	uint32_t m_windowMs;
+	uint64_t m_startMs;
+	derived_value m_channel[derived_count];
+	} derived_state;
+
+// What a reader needs of each channel, small enough to copy every pass.
+typedef struct derived_summary {
+	bool m_valid;
+	ecu_real m_value;
+	ecu_real m_min;
+	ecu_real m_max;
+	ecu_real m_mean;
+	ecu_real m_peak;
+	} derived_summary;
+
+extern void derived_init(derived_state* d, uint32_t windowMs, uint64_t startMs);
+extern void derived_update(derived_state* d, uint64_t timeMs, const ecu_data* dat);
+extern void derived_reset_peaks(derived_state* d);
+extern void derived_summarise(const derived_state* d, derived_summary* sums);
+extern const char* derived_name(derived_channel ch);
+extern ecu_real duty_cycle(ecu_real pulseWidthMs, unsigned int rpm);
+
+#endif
@@ -0,0 +1,206 @@
+#include <string.h>
+#include "history.h"
+
+/*
+ * Bucket slots store their bucket number plus one, so a zeroed slot never
+ * looks valid. Times are milliseconds since m_startMs.
+ */
+
+static void feed(history_open* open, uint32_t index, int32_t value, history_bucket* ring, uint32_t size);
+static void close_bucket(const history_open* open, history_bucket* ring, uint32_t size);
+static int collect(uint32_t fromMs, uint32_t toMs, uint32_t resMs,
+		const history_bucket* ring, uint32_t size, const history_open* open, history_point* out);
+
+void history_init(history* h, uint64_t startMs) {
+
+	memset(h, 0, sizeof(*h));
+	h->m_startMs = startMs;
+
+}
+
+void history_add(history* h, uint64_t timeMs, const ecu_data* dat) {
+	uint32_t t = timeMs - h->m_startMs;
+	int type;
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		history_channel* ch = &h->m_channel[type];
+		int32_t values[SAMPLE_MAX_VALUES];
+
+		if(! (dat->m_sampled & (1u << type)) || (sample_encode(dat, type, values) == 0)) {
+			continue;
+		}
+
+		ch->m_raw[ch->m_rawCount % HISTORY_RAW].m_timeMs = t;
+		ch->m_raw[ch->m_rawCount % HISTORY_RAW].m_value = values[0];
+		ch->m_rawCount++;
+
+		feed(&ch->m_openSecond, t / 1000, values[0], ch->m_seconds, HISTORY_SECONDS);
+		feed(&ch->m_openTen, t / 10000, values[0], ch->m_tens, HISTORY_TENS);
+	}
+
+	h->m_lastMs = t;
+
+}
+
+// Up to width points covering the last spanMs, read from the finest ring that reaches back that far.
+int history_graph(const history* h, SampleType type, uint32_t spanMs, history_point* out, int width) {
+	const history_channel* ch = &h->m_channel[type];
+	history_point points[HISTORY_MAX_POINTS];
+	uint32_t to = h->m_lastMs;
+	uint32_t from;
+	uint32_t oldest;
+	int n = 0;
+
+	if(spanMs > HISTORY_TENS * 10000) {
+		spanMs = HISTORY_TENS * 10000;
+	}
+
+	from = (to > spanMs) ? to - spanMs : 0;
+	oldest = (ch->m_rawCount > HISTORY_RAW) ? ch->m_rawCount - HISTORY_RAW : 0;
+
+	if((ch->m_rawCount > 0) && ((oldest == 0) || (ch->m_raw[oldest % HISTORY_RAW].m_timeMs <= from))) {
+		uint32_t i;
+
+		for(i = oldest; i < ch->m_rawCount; i++) {
+			if(ch->m_raw[i % HISTORY_RAW].m_timeMs >= from) {
+				points[n++] = ch->m_raw[i % HISTORY_RAW];
+			}
+		}
+	}
+	else if(spanMs <= HISTORY_SECONDS * 1000) {
+		n = collect(from, to, 1000, ch->m_seconds, HISTORY_SECONDS, &ch->m_openSecond, points);
+	}
+	else {
+		n = collect(from, to, 10000, ch->m_tens, HISTORY_TENS, &ch->m_openTen, points);
+	}
+
+	if(n <= width) {
+		memcpy(out, points, n * sizeof(history_point));
+		return n;
+	}
+
+	return lttb(points, n, out, width);
+}
+
+/*
+ * Largest-Triangle-Three-Buckets: keep the first and last points and, from
+ * each of threshold - 2 equal buckets in between, the point making the
+ * largest triangle with the point kept before it and the average of the
+ * next bucket. Spikes make large triangles, so they survive. Areas are
+ * compared scaled by the next bucket's size, which keeps them in integers.
+ */
+int lttb(const history_point* in, int count, history_point* out, int threshold) {
+	int a = 0;
+	int i, n = 0;
+
+	if((threshold >= count) || (threshold < 3)) {
+		n = (threshold < count) ? threshold : count;
+		memcpy(out, in, n * sizeof(history_point));
+		return n;
+	}
+
+	out[n++] = in[0];
+
+	for(i = 0; i < threshold - 2; i++) {
+		int start = i * (count - 2) / (threshold - 2) + 1;
+		int end = (i + 1) * (count - 2) / (threshold - 2) + 1;
+		int nextStart = end;
+		int nextEnd = (i + 2) * (count - 2) / (threshold - 2) + 1;
+		int64_t sumT = 0, sumV = 0;
+		int64_t best = -1;
+		int pick = start;
+		int j;
+
+		if(nextEnd > count) {
+			nextEnd = count;
+		}
+
+		// everything relative to the point kept last
+		for(j = nextStart; j < nextEnd; j++) {
+			sumT += (int64_t)in[j].m_timeMs - in[a].m_timeMs;
+			sumV += (int64_t)in[j].m_value - in[a].m_value;
+		}
+
+		for(j = start; j < end; j++) {
+			int64_t area = ((int64_t)in[j].m_timeMs - in[a].m_timeMs) * sumV - sumT * ((int64_t)in[j].m_value - in[a].m_value);
+
+			if(area < 0) {
+				area = -area;
+			}
+
+			if(area > best) {
+				best = area;
+				pick = j;
+			}
+		}
+
+		out[n++] = in[pick];
+		a = pick;
+	}
+
+	out[n++] = in[count - 1];
+
+	return n;
+}
+
+static void feed(history_open* open, uint32_t index, int32_t value, history_bucket* ring, uint32_t size) {
+
+	if(open->m_count && (open->m_index != index)) {
+		close_bucket(open, ring, size);
+		open->m_count = 0;
+	}
+
+	if(open->m_count == 0) {
+		open->m_index = index;
+		open->m_min = value;
+		open->m_max = value;
+		open->m_sum = 0;
+	}
+
+	if(value < open->m_min) open->m_min = value;
+	if(value > open->m_max) open->m_max = value;
+	open->m_sum += value;
+	open->m_count++;
+
+}
+
+static void close_bucket(const history_open* open, history_bucket* ring, uint32_t size) {
+	history_bucket* b = &ring[open->m_index % size];
+
+	b->m_index = open->m_index + 1;
+	b->m_min = open->m_min;
+	b->m_max = open->m_max;
+	b->m_mean = open->m_sum / open->m_count;
+
+}
+
+// Each bucket becomes two points, its min and its max, so the extremes are there for LTTB to keep.
+static int collect(uint32_t fromMs, uint32_t toMs, uint32_t resMs,
+		const history_bucket* ring, uint32_t size, const history_open* open, history_point* out) {
+	uint32_t b;
+	int n = 0;
+
+	for(b = fromMs / resMs; b <= toMs / resMs; b++) {
+		const history_bucket* slot = &ring[b % size];
+		int32_t lo, hi;
+
+		if(open->m_count && (open->m_index == b)) {
+			lo = open->m_min;
+			hi = open->m_max;
+		}
+		else if(slot->m_index == b + 1) {
+			lo = slot->m_min;
+			hi = slot->m_max;
+		}
+		else {
+			continue;
+		}
+
+		out[n].m_timeMs = b * resMs;
+		out[n++].m_value = lo;
+		out[n].m_timeMs = b * resMs + resMs / 2;
+		out[n++].m_value = hi;
+	}
+
+	return n;
+}
@@ -0,0 +1,67 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "samples.h"
+
+/*
+ * Fixed-size sample history for every SampleType, kept at three
+ * resolutions: the last HISTORY_RAW samples as read, one second buckets
+ * for the last HISTORY_SECONDS seconds and ten second buckets for the
+ * last HISTORY_TENS * 10 seconds. Buckets hold the min, max and mean of
+ * whatever arrived in them; a slot is only valid if its m_index is the
+ * bucket number expected there, so gaps need no filling. Only the first
+ * sample_encode() value of each channel is kept.
+ *
+ * Everything is allocated up front: sizeof(history) is about 330 KB and
+ * never grows. A graph of any span reads at most HISTORY_MAX_POINTS points
+ * from the finest ring that covers it, then LTTB brings that down to the
+ * screen width, so drawing costs the same however long the history is.
+ */
+
+#define HISTORY_RAW		256
+#define HISTORY_SECONDS		600
+#define HISTORY_TENS		360
+#define HISTORY_MAX_POINTS	(2 * (HISTORY_SECONDS + 1))
+
+typedef struct history_point {
+	uint32_t m_timeMs;
+	int32_t m_value;
+	} history_point;
+
+typedef struct history_bucket {
+	uint32_t m_index;
+	int32_t m_min;
+	int32_t m_max;
+	int32_t m_mean;
+	} history_bucket;
+
+// The bucket still filling up, for one resolution.
+typedef struct history_open {
+	uint32_t m_index;
+	uint32_t m_count;
+	int32_t m_min;
+	int32_t m_max;
+	int64_t m_sum;
+	} history_open;
+
+typedef struct history_channel {
+	history_point m_raw[HISTORY_RAW];
+	uint32_t m_rawCount;
+	history_bucket m_seconds[HISTORY_SECONDS];
+	history_bucket m_tens[HISTORY_TENS];
+	history_open m_openSecond;
+	history_open m_openTen;
+	} history_channel;
+
+typedef struct history {
+	uint64_t m_startMs;
+	uint32_t m_lastMs;
+	history_channel m_channel[SampleType_NumSampleTypes];
+	} history;
+
+extern void history_init(history* h, uint64_t startMs);
+extern void history_add(history* h, uint64_t timeMs, const ecu_data* dat);
+extern int history_graph(const history* h, SampleType type, uint32_t spanMs, history_point* out, int width);
+extern int lttb(const history_point* in, int count, history_point* out, int threshold);
+
+#endif
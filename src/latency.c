@@ -0,0 +1,117 @@
+#include <string.h>
+#include "latency.h"
+
+/*
+ * Fixed-size latency histograms: recording is a couple of shifts and an
+ * increment, with no allocation, so it can sit on every ECU call. Counters
+ * are updated with relaxed atomics by the polling thread and may be read at
+ * any time from another; a reader can see a count a few samples apart from
+ * the buckets, which is fine for display.
+ */
+
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define BUMP(x, n)	__atomic_store_n(&(x), LOAD(x) + (n), __ATOMIC_RELAXED)
+
+static int bucket_for(uint32_t us);
+static uint32_t percentile(const latency_hist* h, uint32_t count, unsigned int pct);
+
+void latency_reset(latency_hist* h) {
+	memset(h, 0, sizeof(*h));
+}
+
+void latency_record(latency_hist* h, uint32_t us, bool ok) {
+
+	BUMP(h->m_buckets[bucket_for(us)], 1);
+	BUMP(h->m_count, 1);
+
+	if(! ok) {
+		BUMP(h->m_failures, 1);
+	}
+
+	if(us > LOAD(h->m_maxUs)) {
+		__atomic_store_n(&h->m_maxUs, us, __ATOMIC_RELAXED);
+	}
+
+}
+
+void latency_summarise(const latency_hist* h, latency_summary* sum) {
+	uint32_t count = LOAD(h->m_count);
+
+	sum->m_count = count;
+	sum->m_failures = LOAD(h->m_failures);
+	sum->m_maxUs = LOAD(h->m_maxUs);
+	sum->m_p50Us = percentile(h, count, 50);
+	sum->m_p95Us = percentile(h, count, 95);
+
+}
+
+uint32_t latency_bucket_floor(int bucket) {
+	int sub = bucket & ((1 << LAT_SUB_BITS) - 1);
+	int shift = (bucket >> LAT_SUB_BITS) - 1;
+
+	if(bucket < (1 << LAT_SUB_BITS)) {
+		return bucket;
+	}
+
+	return (uint32_t)((1 << LAT_SUB_BITS) + sub) << shift;
+}
+
+void latency_print(FILE* f, const char* name, const latency_hist* h) {
+	latency_summary sum;
+	int i;
+
+	latency_summarise(h, &sum);
+
+	if(sum.m_count == 0) {
+		return;
+	}
+
+	fprintf(f, "%-20s %8u calls %6u failed  p50 %7.2fms  p95 %7.2fms  max %7.2fms\n", name, sum.m_count, sum.m_failures, sum.m_p50Us / 1000.0, sum.m_p95Us / 1000.0, sum.m_maxUs / 1000.0);
+
+	for(i = 0; i < LAT_BUCKETS; i++) {
+		uint32_t n = LOAD(h->m_buckets[i]);
+
+		if(n) {
+			fprintf(f, "  >= %8uus %8u\n", latency_bucket_floor(i), n);
+		}
+	}
+
+}
+
+static int bucket_for(uint32_t us) {
+	int msb;
+	int bucket;
+
+	if(us < (1 << LAT_SUB_BITS)) {
+		return us;
+	}
+
+	msb = 31 - __builtin_clz(us);
+	bucket = ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + ((us >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+
+	return bucket < LAT_BUCKETS ? bucket : LAT_BUCKETS - 1;
+}
+
+// Reports the upper edge of the bucket holding the percentile, clamped to the largest value seen.
+static uint32_t percentile(const latency_hist* h, uint32_t count, unsigned int pct) {
+	uint64_t rank = ((uint64_t)count * pct + 99) / 100;
+	uint64_t seen = 0;
+	uint32_t max = LOAD(h->m_maxUs);
+	int i;
+
+	if(count == 0) {
+		return 0;
+	}
+
+	for(i = 0; i < LAT_BUCKETS - 1; i++) {
+		seen += LOAD(h->m_buckets[i]);
+
+		if(seen >= rank) {
+			uint32_t edge = latency_bucket_floor(i + 1);
+
+			return edge < max ? edge : max;
+		}
+	}
+
+	return max;
+}
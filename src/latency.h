@@ -0,0 +1,33 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Log-linear buckets: four per power of two, exact below 4us, up to about 16s.
+#define LAT_SUB_BITS	2
+#define LAT_BUCKETS	96
+
+typedef struct latency_hist {
+	uint32_t m_buckets[LAT_BUCKETS];
+	uint32_t m_count;
+	uint32_t m_failures;
+	uint32_t m_maxUs;
+	} latency_hist;
+
+typedef struct latency_summary {
+	uint32_t m_count;
+	uint32_t m_failures;
+	uint32_t m_p50Us;
+	uint32_t m_p95Us;
+	uint32_t m_maxUs;
+	} latency_summary;
+
+extern void latency_reset(latency_hist* h);
+extern void latency_record(latency_hist* h, uint32_t us, bool ok);
+extern void latency_summarise(const latency_hist* h, latency_summary* sum);
+extern uint32_t latency_bucket_floor(int bucket);
+extern void latency_print(FILE* f, const char* name, const latency_hist* h);
+
+#endif
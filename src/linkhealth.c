@@ -0,0 +1,103 @@
+#include <string.h>
+#include "linkhealth.h"
+
+/*
+ * Link health for one ECU connection. Nothing here touches the port: the
+ * caller reports each pass and asks what to do next.
+ *
+ *   up      -- LINK_FAIL_PASSES failed passes -->  down
+ *   down    -- reconnect and probe succeed    -->  resync
+ *   resync  -- every channel read again       -->  up
+ *
+ * While down, reconnect attempts back off from LINK_BACKOFF_MIN_MS to
+ * LINK_BACKOFF_MAX_MS, so a link that comes back is picked up within
+ * LINK_BACKOFF_MAX_MS. A resync that keeps failing drops straight back to
+ * down. The state is read by other threads, so it is stored atomically.
+ */
+
+static void set_state(link_health* l, link_state state);
+
+void link_init(link_health* l) {
+
+	memset(l, 0, sizeof(*l));
+	latency_reset(&l->m_outage);
+	latency_reset(&l->m_resync);
+	l->m_state = linkstate_up;
+
+}
+
+// After each pass while connected; read is the mask of channels it covered. True means close the link.
+bool link_pass(link_health* l, uint64_t nowUs, bool ok, uint32_t read) {
+
+	if(! ok) {
+		if(l->m_failStreak++ == 0) {
+			l->m_firstFailUs = nowUs;
+		}
+
+		if(l->m_failStreak < LINK_FAIL_PASSES) {
+			return false;
+		}
+
+		// a failed resync carries on the outage that caused it
+		if(l->m_state == linkstate_up) {
+			__atomic_store_n(&l->m_drops, l->m_drops + 1, __ATOMIC_RELAXED);
+			l->m_backoffMs = LINK_BACKOFF_MIN_MS;
+		}
+
+		l->m_nextAttemptUs = nowUs + l->m_backoffMs * 1000;
+		set_state(l, linkstate_down);
+
+		return true;
+	}
+
+	if(l->m_state == linkstate_resync) {
+		l->m_pending &= ~read;
+
+		if(l->m_pending == 0) {
+			latency_record(&l->m_resync, (uint32_t)(nowUs - l->m_reconnectedUs), true);
+			set_state(l, linkstate_up);
+		}
+	}
+
+	l->m_failStreak = 0;
+
+	return false;
+}
+
+bool link_attempt_due(link_health* l, uint64_t nowUs) {
+	return (l->m_state == linkstate_down) && (nowUs >= l->m_nextAttemptUs);
+}
+
+void link_attempt_failed(link_health* l, uint64_t nowUs) {
+
+	__atomic_store_n(&l->m_attempts, l->m_attempts + 1, __ATOMIC_RELAXED);
+	l->m_backoffMs = (l->m_backoffMs * 2 > LINK_BACKOFF_MAX_MS) ? LINK_BACKOFF_MAX_MS : l->m_backoffMs * 2;
+	l->m_nextAttemptUs = nowUs + l->m_backoffMs * 1000;
+
+}
+
+// The port is open again and answered a probe; channels is the mask that must be read before the link counts as up.
+void link_reconnected(link_health* l, uint64_t nowUs, uint32_t channels) {
+
+	__atomic_store_n(&l->m_attempts, l->m_attempts + 1, __ATOMIC_RELAXED);
+	l->m_failStreak = 0;
+	l->m_reconnectedUs = nowUs;
+	l->m_pending = channels;
+	latency_record(&l->m_outage, (uint32_t)(nowUs - l->m_firstFailUs), true);
+	set_state(l, linkstate_resync);
+
+}
+
+void link_get_stats(const link_health* l, link_stats* stats) {
+
+	stats->m_state = __atomic_load_n(&l->m_state, __ATOMIC_RELAXED);
+	stats->m_drops = __atomic_load_n(&l->m_drops, __ATOMIC_RELAXED);
+	stats->m_attempts = __atomic_load_n(&l->m_attempts, __ATOMIC_RELAXED);
+	latency_summarise(&l->m_outage, &stats->m_outage);
+	latency_summarise(&l->m_resync, &stats->m_resync);
+
+}
+
+static void set_state(link_health* l, link_state state) {
+	__atomic_store_n(&l->m_state, state, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,49 @@
+#ifndef LINKHEALTH_H
+#define LINKHEALTH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "latency.h"
+
+// Passes in a row that read nothing before the link is dropped and reopened.
+#define LINK_FAIL_PASSES	3
+// Wait before each reconnect attempt, doubling after every failure.
+#define LINK_BACKOFF_MIN_MS	250
+#define LINK_BACKOFF_MAX_MS	4000
+
+typedef enum link_state {
+	linkstate_up,
+	linkstate_down,		// closed, waiting to reconnect
+	linkstate_resync	// reopened, and not every channel has been read since
+	} link_state;
+
+typedef struct link_health {
+	link_state m_state;
+	uint32_t m_failStreak;
+	uint64_t m_firstFailUs;
+	uint64_t m_reconnectedUs;
+	uint64_t m_nextAttemptUs;
+	uint32_t m_backoffMs;
+	uint32_t m_pending;	// channels still to be read after a reconnect
+	uint32_t m_drops;
+	uint32_t m_attempts;
+	latency_hist m_outage;	// first failed pass to a successful reconnect
+	latency_hist m_resync;	// reconnect to every channel read again
+	} link_health;
+
+typedef struct link_stats {
+	link_state m_state;
+	uint32_t m_drops;
+	uint32_t m_attempts;
+	latency_summary m_outage;
+	latency_summary m_resync;
+	} link_stats;
+
+extern void link_init(link_health* l);
+extern bool link_pass(link_health* l, uint64_t nowUs, bool ok, uint32_t read);
+extern bool link_attempt_due(link_health* l, uint64_t nowUs);
+extern void link_attempt_failed(link_health* l, uint64_t nowUs);
+extern void link_reconnected(link_health* l, uint64_t nowUs, uint32_t channels);
+extern void link_get_stats(const link_health* l, link_stats* stats);
+
+#endif
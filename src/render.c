@@ -0,0 +1,210 @@
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "render.h"
+#include "renderterm.h"
+#include "scheduler.h"
+
+/*
+ * Every value on the main screen goes through a numbered field that keeps
+ * the text and attribute it last drew. A field whose formatted text has not
+ * changed costs a snprintf and a compare, and nothing reaches the terminal
+ * backend. Static labels are drawn with render_text() and are not tracked.
+ *
+ * With measuring on, the bytes written to the terminal are taken from the
+ * kernel's per-thread write counter. Only the UI thread writes to the
+ * terminal, and both backends write straight to the descriptor, so this
+ * counts every escape sequence as well as the text. Kernels before 3.17 have
+ * no /proc/thread-self, so the thread's entry under /proc/self/task is
+ * tried as well; with neither, the byte count is reported as unavailable.
+ */
+
+typedef struct render_slot {
+	char m_text[RENDER_FIELD_LEN];
+	int m_attr;
+	bool m_valid;
+	} render_slot;
+
+static FILE* open_thread_io();
+static bool thread_written(uint64_t* bytes);
+
+static render_slot slots[RENDER_MAX_FIELDS];
+static bool measureRequested;
+// the write counter was read at both ends
+static bool measuring;
+static uint64_t startUs;
+static uint64_t endUs;
+static uint64_t startBytes;
+static uint64_t termBytes;
+static uint32_t emitted;
+static uint32_t unchanged;
+
+bool render_begin(bool measure) {
+
+	measureRequested = measure;
+	measuring = measure && thread_written(&startBytes);
+	termBytes = 0;
+	emitted = 0;
+	unchanged = 0;
+	render_invalidate();
+
+	if(! term_begin()) {
+		return false;
+	}
+
+	startUs = monotonic_us();
+	endUs = 0;
+
+	return true;
+}
+
+void render_end() {
+	uint64_t bytes;
+
+	term_end();
+
+	// snapshot now, before anything else is printed to the terminal
+	endUs = monotonic_us();
+
+	if(measuring) {
+		measuring = thread_written(&bytes);
+		termBytes = measuring ? bytes - startBytes : 0;
+	}
+
+}
+
+void render_text(int row, int col, int attr, const char* fmt, ...) {
+	char text[RENDER_LINE_LEN];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+
+	term_put(false, row, col, attr, text);
+
+}
+
+void render_field(int field, int row, int col, int attr, const char* fmt, ...) {
+	render_slot* s = &slots[field];
+	char text[RENDER_FIELD_LEN];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+
+	if(s->m_valid && (s->m_attr == attr) && (strcmp(s->m_text, text) == 0)) {
+		unchanged++;
+		return;
+	}
+
+	strcpy(s->m_text, text);
+	s->m_attr = attr;
+	s->m_valid = true;
+	emitted++;
+
+	term_put(false, row, col, attr, text);
+
+}
+
+// Forget what every field shows; call after anything that redraws the screen underneath them.
+void render_invalidate() {
+	memset(slots, 0, sizeof(slots));
+}
+
+// The popup sits over the main screen from row top down; it has a border, so its own rows and columns start at 1.
+void render_popup_init(int top, int rows, int cols) {
+	term_popup_init(top, rows, cols);
+}
+
+void render_popup_clear() {
+	term_popup_clear();
+}
+
+void render_popup_text(int row, int col, int attr, const char* fmt, ...) {
+	char text[RENDER_LINE_LEN];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(text, sizeof(text), fmt, args);
+	va_end(args);
+
+	term_put(true, row, col, attr, text);
+
+}
+
+void render_popup_show(bool shown) {
+	term_popup_show(shown);
+}
+
+void render_flush() {
+	term_flush();
+}
+
+bool render_get_stats(render_stats* stats) {
+
+	stats->m_counted = measuring;
+	stats->m_bytes = termBytes;
+	stats->m_elapsedUs = (endUs ? endUs : monotonic_us()) - startUs;
+	stats->m_emitted = emitted;
+	stats->m_unchanged = unchanged;
+
+	return measureRequested;
+}
+
+void print_render_stats(FILE* f) {
+	render_stats stats;
+	double secs;
+
+	if(! render_get_stats(&stats)) {
+		return;
+	}
+
+	secs = stats.m_elapsedUs / 1e6;
+
+	if(stats.m_counted) {
+		fprintf(f, "Terminal output: %llu bytes in %.1fs (%.0f bytes/s)\n", (unsigned long long)stats.m_bytes, secs, secs > 0 ? stats.m_bytes / secs : 0);
+	}
+	else {
+		fprintf(f, "Terminal output: unavailable, no per-thread I/O counters in /proc\n");
+	}
+
+	fprintf(f, "Field updates: %u drawn, %u unchanged\n", stats.m_emitted, stats.m_unchanged);
+
+}
+
+static FILE* open_thread_io() {
+	char path[64];
+	FILE* f = fopen("/proc/thread-self/io", "r");
+
+	if(! f) {
+		snprintf(path, sizeof(path), "/proc/self/task/%ld/io", (long)syscall(SYS_gettid));
+		f = fopen(path, "r");
+	}
+
+	return f;
+}
+
+static bool thread_written(uint64_t* bytes) {
+	FILE* f = open_thread_io();
+	unsigned long long value;
+	char name[32];
+	bool found = false;
+
+	if(! f) {
+		return false;
+	}
+
+	while(! found && (fscanf(f, "%31s %llu", name, &value) == 2)) {
+		if(strcmp(name, "wchar:") == 0) {
+			*bytes = value;
+			found = true;
+		}
+	}
+
+	fclose(f);
+
+	return found;
+}
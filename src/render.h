@@ -0,0 +1,45 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Drawing for roverdisplay: a main screen of tracked fields and static
+ * text, and one popup window over it. render.c does the formatting and
+ * field tracking; the terminal itself is either curses (render_curses.c)
+ * or, for roverdisplay-lite, a built-in VT100 writer (render_vt.c).
+ */
+
+// Longest formatted value a field may hold, and how many fields the screen has.
+#define RENDER_FIELD_LEN	32
+#define RENDER_MAX_FIELDS	32
+// Longest line of static text.
+#define RENDER_LINE_LEN		256
+
+#define RENDER_NORMAL	0
+#define RENDER_REVERSE	1
+
+typedef struct render_stats {
+	bool m_counted;		// false if the kernel had no write counter for this thread
+	uint64_t m_bytes;
+	uint64_t m_elapsedUs;
+	uint32_t m_emitted;
+	uint32_t m_unchanged;
+	} render_stats;
+
+extern bool render_begin(bool measure);
+extern void render_end();
+extern void render_text(int row, int col, int attr, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+extern void render_field(int field, int row, int col, int attr, const char* fmt, ...) __attribute__((format(printf, 5, 6)));
+extern void render_invalidate();
+extern void render_popup_init(int top, int rows, int cols);
+extern void render_popup_clear();
+extern void render_popup_text(int row, int col, int attr, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+extern void render_popup_show(bool shown);
+extern void render_flush();
+extern bool render_get_stats(render_stats* stats);
+extern void print_render_stats(FILE* f);
+
+#endif
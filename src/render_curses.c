@@ -0,0 +1,81 @@
+#include <curses.h>
+#include <panel.h>
+#include "render.h"
+#include "renderterm.h"
+
+/*
+ * The curses backend: stdscr is the main screen and the popup is a window
+ * on a panel of its own, so hiding it brings back whatever was underneath.
+ */
+
+static WINDOW* popupw;
+static PANEL* mainp;
+static PANEL* popupp;
+
+bool term_begin() {
+
+	if(! initscr()) {
+		return false;
+	}
+
+	cbreak();
+	clear();
+	curs_set(0);
+	mainp = new_panel(stdscr);
+
+	return true;
+}
+
+void term_end() {
+
+	echo();
+	endwin();
+
+}
+
+void term_put(bool popup, int row, int col, int attr, const char* text) {
+	WINDOW* w = popup ? popupw : stdscr;
+
+	if(! w) {
+		return;
+	}
+
+	if(attr & RENDER_REVERSE) wattron(w, A_REVERSE);
+	mvwaddstr(w, row, col, text);
+	wattroff(w, A_REVERSE);
+
+}
+
+void term_popup_init(int top, int rows, int cols) {
+
+	popupw = newwin(rows, cols, top, 0);
+	popupp = new_panel(popupw);
+	hide_panel(popupp);
+
+}
+
+// werase() rather than wclear(), so curses sends only what moved.
+void term_popup_clear() {
+
+	werase(popupw);
+	box(popupw, 0, 0);
+
+}
+
+void term_popup_show(bool shown) {
+
+	if(shown) {
+		show_panel(popupp);
+	}
+	else {
+		hide_panel(popupp);
+	}
+
+}
+
+void term_flush() {
+
+	update_panels();
+	doupdate();
+
+}
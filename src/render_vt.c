@@ -0,0 +1,247 @@
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <termios.h>
+#include "render.h"
+#include "renderterm.h"
+
+/*
+ * The VT100 backend used by roverdisplay-lite, in place of curses and
+ * panel. The main screen and the popup are each a grid of cells; at
+ * term_flush() the popup, if shown, is laid over the main screen and every
+ * cell that differs from what the terminal already shows is sent, with
+ * cursor moves only where the next cell is not the one the cursor is on.
+ * A flush is one write(). Box lines use the DEC special graphics set, as
+ * curses does on a vt100.
+ *
+ * The screen is a fixed VT_ROWS by VT_COLS and is never resized; anything
+ * drawn beyond it is dropped.
+ */
+
+#define VT_ROWS		24
+#define VT_COLS		80
+#define VT_OUT_LEN	8192
+
+// Cell attributes beyond RENDER_REVERSE.
+#define CELL_LINE	0x80	// m_ch is a DEC special graphics character
+
+#define EMIT_LITERAL(s)	emit(s, sizeof(s) - 1)
+
+typedef struct vt_cell {
+	char m_ch;
+	unsigned char m_attr;
+	} vt_cell;
+
+static void put_cells(vt_cell* row, int col, int cols, int attr, const char* text);
+static void emit(const char* text, size_t len);
+static void emit_flush();
+
+static vt_cell screen[VT_ROWS][VT_COLS];
+static vt_cell popup[VT_ROWS][VT_COLS];
+static vt_cell shown[VT_ROWS][VT_COLS];	// what the terminal has now
+static int popupTop, popupRows, popupCols;
+static bool popupShown;
+static int usedRows;
+static int cursorRow, cursorCol;	// -1 when not known
+static int currentAttr;
+static struct termios savedTermios;
+static bool restoreTermios;
+static char out[VT_OUT_LEN];
+static size_t outLen;
+
+bool term_begin() {
+	struct termios raw;
+	int r, c;
+
+	// like curses' cbreak(): keys arrive one at a time, unechoed, and ^C still signals
+	if(tcgetattr(STDIN_FILENO, &savedTermios) == 0) {
+		raw = savedTermios;
+		raw.c_lflag &= ~(ICANON | ECHO);
+		raw.c_cc[VMIN] = 1;
+		raw.c_cc[VTIME] = 0;
+		restoreTermios = (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0);
+	}
+
+	for(r = 0; r < VT_ROWS; r++) {
+		for(c = 0; c < VT_COLS; c++) {
+			screen[r][c].m_ch = ' ';
+			screen[r][c].m_attr = RENDER_NORMAL;
+		}
+	}
+
+	memcpy(shown, screen, sizeof(shown));
+	popupShown = false;
+	popupRows = 0;
+	usedRows = 0;
+	cursorRow = 0;
+	cursorCol = 0;
+	currentAttr = RENDER_NORMAL;
+	outLen = 0;
+
+	// plain attributes, ASCII, cursor hidden, screen cleared
+	EMIT_LITERAL("\033[0m\033(B\033[?25l\033[H\033[2J");
+	emit_flush();
+
+	return true;
+}
+
+void term_end() {
+	char move[16];
+
+	EMIT_LITERAL("\033[0m\033(B\033[?25h");
+	emit(move, snprintf(move, sizeof(move), "\033[%d;1H\r\n", usedRows));
+	emit_flush();
+
+	if(restoreTermios) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+		restoreTermios = false;
+	}
+
+}
+
+void term_put(bool inPopup, int row, int col, int attr, const char* text) {
+
+	if(inPopup) {
+		if((row >= 0) && (row < popupRows)) {
+			put_cells(popup[row], col, popupCols, attr, text);
+		}
+	}
+	else if((row >= 0) && (row < VT_ROWS)) {
+		put_cells(screen[row], col, VT_COLS, attr, text);
+
+		if(row >= usedRows) {
+			usedRows = row + 1;
+		}
+	}
+
+}
+
+void term_popup_init(int top, int rows, int cols) {
+
+	popupTop = (top < VT_ROWS) ? top : VT_ROWS;
+	popupRows = (popupTop + rows <= VT_ROWS) ? rows : VT_ROWS - popupTop;
+	popupCols = (cols <= VT_COLS) ? cols : VT_COLS;
+	popupShown = false;
+
+	if(popupTop + popupRows > usedRows) {
+		usedRows = popupTop + popupRows;
+	}
+
+	term_popup_clear();
+
+}
+
+// Blank the popup and draw its border.
+void term_popup_clear() {
+	int r, c;
+
+	if((popupRows < 2) || (popupCols < 2)) {
+		return;
+	}
+
+	for(r = 0; r < popupRows; r++) {
+		for(c = 0; c < popupCols; c++) {
+			bool edgeRow = (r == 0) || (r == popupRows - 1);
+			bool edgeCol = (c == 0) || (c == popupCols - 1);
+
+			popup[r][c].m_attr = (edgeRow || edgeCol) ? CELL_LINE : RENDER_NORMAL;
+			popup[r][c].m_ch = edgeRow ? (edgeCol ? ' ' : 'q') : (edgeCol ? 'x' : ' ');
+		}
+	}
+
+	popup[0][0].m_ch = 'l';
+	popup[0][popupCols - 1].m_ch = 'k';
+	popup[popupRows - 1][0].m_ch = 'm';
+	popup[popupRows - 1][popupCols - 1].m_ch = 'j';
+
+}
+
+void term_popup_show(bool on) {
+	popupShown = on;
+}
+
+void term_flush() {
+	char seq[24];
+	int r, c;
+
+	for(r = 0; r < usedRows; r++) {
+		bool overlaid = popupShown && (r >= popupTop) && (r < popupTop + popupRows);
+
+		for(c = 0; c < VT_COLS; c++) {
+			const vt_cell* want = (overlaid && (c < popupCols)) ? &popup[r - popupTop][c] : &screen[r][c];
+			int changed;
+
+			if((want->m_ch == shown[r][c].m_ch) && (want->m_attr == shown[r][c].m_attr)) {
+				continue;
+			}
+
+			if((r != cursorRow) || (c != cursorCol)) {
+				emit(seq, snprintf(seq, sizeof(seq), "\033[%d;%dH", r + 1, c + 1));
+			}
+
+			changed = want->m_attr ^ currentAttr;
+
+			if(changed & RENDER_REVERSE) {
+				emit((want->m_attr & RENDER_REVERSE) ? "\033[7m" : "\033[0m", 4);
+			}
+
+			if(changed & CELL_LINE) {
+				emit((want->m_attr & CELL_LINE) ? "\033(0" : "\033(B", 3);
+			}
+
+			emit(&want->m_ch, 1);
+			currentAttr = want->m_attr;
+			shown[r][c] = *want;
+			cursorRow = r;
+			// the last column leaves the cursor waiting to wrap, so always move after it
+			cursorCol = (c + 1 < VT_COLS) ? c + 1 : -1;
+		}
+	}
+
+	emit_flush();
+
+}
+
+// Copy text into one row of cells from col, stopping at the row's end or any control character.
+static void put_cells(vt_cell* row, int col, int cols, int attr, const char* text) {
+
+	for(; *text && (col < cols); text++, col++) {
+		if((unsigned char)*text < ' ') {
+			break;
+		}
+
+		if(col >= 0) {
+			row[col].m_ch = *text;
+			row[col].m_attr = attr & RENDER_REVERSE;
+		}
+	}
+
+}
+
+static void emit(const char* text, size_t len) {
+
+	if(outLen + len > sizeof(out)) {
+		emit_flush();
+	}
+
+	memcpy(out + outLen, text, len);
+	outLen += len;
+
+}
+
+static void emit_flush() {
+	size_t done = 0;
+
+	while(done < outLen) {
+		ssize_t n = write(STDOUT_FILENO, out + done, outLen - done);
+
+		if(n <= 0) {
+			break;
+		}
+
+		done += n;
+	}
+
+	outLen = 0;
+
+}
@@ -0,0 +1,21 @@
+#ifndef RENDERTERM_H
+#define RENDERTERM_H
+
+#include <stdbool.h>
+
+/*
+ * What a terminal backend provides to render.c. Text arrives already
+ * formatted and is drawn as it is; rows and columns are relative to the
+ * main screen or to the popup. Nothing need reach the terminal before
+ * term_flush().
+ */
+
+extern bool term_begin();
+extern void term_end();
+extern void term_put(bool popup, int row, int col, int attr, const char* text);
+extern void term_popup_init(int top, int rows, int cols);
+extern void term_popup_clear();
+extern void term_popup_show(bool shown);
+extern void term_flush();
+
+#endif
@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "replay.h"
+
+/*
+ * Plays a session log back into an ecu_data. The file is mapped rather
+ * than read, and only the index blocks are located at open: through the
+ * trailer's back-linked chain if the log was closed cleanly, or by
+ * walking block headers if it wasn't. Seeking is then a binary search over
+ * the index blocks followed by one within the chosen block's entries.
+ *
+ * Blocks follow one another with no padding, so headers and index entries
+ * sit at arbitrary offsets in the map. They are always decoded byte by byte
+ * with the sessionlog_get_*() functions, never read through a cast pointer,
+ * which also keeps the file little-endian on any host.
+ */
+
+// Slowest channel interval plus a margin, so every channel has a value after a seek.
+#define REPLAY_WARMUP_MS 4000
+
+static bool find_index_chain(replay* r);
+static bool scan_blocks(replay* r);
+static bool block_at(const replay* r, uint64_t offset, uint32_t magic, log_block_header* h);
+static log_index_entry index_entry(const replay* r, uint64_t indexOffset, uint32_t i);
+static uint64_t find_block(const replay* r, uint64_t logMs);
+static void load_block(replay* r, uint64_t offset);
+static void next_block(replay* r);
+static bool apply_group(replay* r, ecu_data* dat);
+
+replay* replay_open(const char* path) {
+	replay* r = calloc(1, sizeof(replay));
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if(! r || (fd < 0) || (fstat(fd, &st) != 0) || (st.st_size < LOG_FILE_HEADER_SIZE)) {
+		if(fd >= 0) close(fd);
+		free(r);
+		return NULL;
+	}
+
+	r->m_size = st.st_size;
+	r->m_map = mmap(NULL, r->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(r->m_map == MAP_FAILED) {
+		free(r);
+		return NULL;
+	}
+
+	log_file_header fh;
+	log_block_header last;
+
+	sessionlog_get_file_header(r->m_map, &fh);
+
+	if((fh.m_magic != LOG_FILE_MAGIC) || (fh.m_version != LOG_VERSION) ||
+			! (find_index_chain(r) || scan_blocks(r)) ||
+			((r->m_indexCount == 0) && (r->m_tailCount == 0))) {
+		replay_close(r);
+		return NULL;
+	}
+
+	bool haveLast;
+
+	if(r->m_tailCount > 0) {
+		r->m_firstMs = (r->m_indexCount > 0) ? index_entry(r, r->m_indexBlocks[0], 0).m_firstMs : r->m_tail[0].m_firstMs;
+		haveLast = block_at(r, r->m_tail[r->m_tailCount - 1].m_offset, LOG_DATA_MAGIC, &last);
+	}
+	else {
+		uint64_t ib = r->m_indexBlocks[r->m_indexCount - 1];
+		log_block_header ih;
+
+		block_at(r, ib, LOG_INDEX_MAGIC, &ih);
+		r->m_firstMs = index_entry(r, r->m_indexBlocks[0], 0).m_firstMs;
+		haveLast = block_at(r, index_entry(r, ib, ih.m_count - 1).m_offset, LOG_DATA_MAGIC, &last);
+	}
+
+	r->m_lastMs = haveLast ? last.m_lastMs : r->m_firstMs;
+	r->m_speed = REPLAY_SPEED_NORMAL;
+
+	load_block(r, find_block(r, r->m_firstMs));
+	r->m_positionMs = r->m_firstMs;
+
+	return r;
+}
+
+void replay_close(replay* r) {
+
+	munmap((void*)r->m_map, r->m_size);
+	free(r->m_indexBlocks);
+	free(r);
+
+}
+
+read_result replay_advance(replay* r, ecu_data* dat, uint64_t nowMs) {
+	read_result result = readresult_nostatement;
+
+	if(! r->m_paused) {
+		r->m_positionMs += (nowMs - r->m_anchorMs) * r->m_speed / REPLAY_SPEED_NORMAL;
+	}
+
+	r->m_anchorMs = nowMs;
+	dat->m_sampled = 0;
+
+	while(! r->m_atEnd && (r->m_block.m_times[r->m_block.m_group] <= r->m_positionMs)) {
+		if(! apply_group(r, dat)) {
+			result = readresult_failure;
+			break;
+		}
+
+		result = readresult_success;
+	}
+
+	if(r->m_positionMs >= r->m_lastMs) {
+		r->m_positionMs = r->m_lastMs;
+		r->m_paused = true;
+		r->m_pausedAtEnd = true;
+	}
+
+	return result;
+}
+
+void replay_seek(replay* r, ecu_data* dat, uint64_t logMs, uint64_t nowMs) {
+	uint64_t from;
+
+	if(logMs < r->m_firstMs) {
+		logMs = r->m_firstMs;
+	}
+	else if(logMs > r->m_lastMs) {
+		logMs = r->m_lastMs;
+	}
+
+	from = (logMs > r->m_firstMs + REPLAY_WARMUP_MS) ? logMs - REPLAY_WARMUP_MS : r->m_firstMs;
+
+	load_block(r, find_block(r, from));
+
+	r->m_positionMs = logMs;
+	r->m_anchorMs = nowMs;
+
+	// running off the end paused playback; seeking back from there carries on playing
+	if(r->m_pausedAtEnd && (logMs < r->m_lastMs)) {
+		r->m_paused = false;
+		r->m_pausedAtEnd = false;
+	}
+
+	while(! r->m_atEnd && (r->m_block.m_times[r->m_block.m_group] <= logMs) && apply_group(r, dat));
+
+}
+
+void replay_set_speed(replay* r, uint32_t speed, uint64_t nowMs) {
+
+	if(speed < REPLAY_SPEED_MIN) {
+		speed = REPLAY_SPEED_MIN;
+	}
+	else if(speed > REPLAY_SPEED_MAX) {
+		speed = REPLAY_SPEED_MAX;
+	}
+
+	if(! r->m_paused) {
+		r->m_positionMs += (nowMs - r->m_anchorMs) * r->m_speed / REPLAY_SPEED_NORMAL;
+	}
+
+	r->m_anchorMs = nowMs;
+	r->m_speed = speed;
+
+}
+
+void replay_set_paused(replay* r, bool paused, uint64_t nowMs) {
+
+	if(! r->m_paused) {
+		r->m_positionMs += (nowMs - r->m_anchorMs) * r->m_speed / REPLAY_SPEED_NORMAL;
+	}
+
+	r->m_anchorMs = nowMs;
+	r->m_paused = paused;
+	r->m_pausedAtEnd = false;
+
+}
+
+static bool find_index_chain(replay* r) {
+	log_trailer trailer;
+	log_block_header h;
+	uint64_t offset;
+	uint64_t maxBlocks;
+	uint32_t n = 0;
+
+	if(r->m_size < LOG_FILE_HEADER_SIZE + LOG_TRAILER_SIZE) {
+		return false;
+	}
+
+	// no more index blocks, each at least one entry long, than the file has room for
+	maxBlocks = (r->m_size - LOG_FILE_HEADER_SIZE) / (LOG_BLOCK_HEADER_SIZE + LOG_INDEX_ENTRY_SIZE);
+
+	sessionlog_get_trailer(r->m_map + r->m_size - LOG_TRAILER_SIZE, &trailer);
+
+	if(trailer.m_magic != LOG_TRAILER_MAGIC) {
+		return false;
+	}
+
+	// the chain has to run strictly backwards to the first index block, whose link is 0; anything else falls back to scan_blocks()
+	for(offset = trailer.m_lastIndex; offset != 0; offset = h.m_prevIndex) {
+		if(! block_at(r, offset, LOG_INDEX_MAGIC, &h) || (h.m_prevIndex >= offset) || (++n > maxBlocks)) {
+			return false;
+		}
+	}
+
+	r->m_indexBlocks = malloc(n * sizeof(*r->m_indexBlocks));
+	r->m_indexCount = n;
+
+	for(offset = trailer.m_lastIndex; offset != 0; offset = h.m_prevIndex) {
+		block_at(r, offset, LOG_INDEX_MAGIC, &h);
+		r->m_indexBlocks[--n] = offset;
+	}
+
+	return true;
+}
+
+// A log that wasn't closed (power cut, crash) has no trailer: walk the headers instead.
+static bool scan_blocks(replay* r) {
+	uint64_t offset = LOG_FILE_HEADER_SIZE;
+	uint32_t capacity = 0;
+
+	while(offset + LOG_BLOCK_HEADER_SIZE <= r->m_size) {
+		log_block_header h;
+
+		sessionlog_get_block_header(r->m_map + offset, &h);
+
+		if(offset + LOG_BLOCK_HEADER_SIZE + h.m_length > r->m_size) {
+			break;
+		}
+
+		if(h.m_magic == LOG_INDEX_MAGIC) {
+			if(! block_at(r, offset, LOG_INDEX_MAGIC, &h)) {
+				break;
+			}
+
+			if(r->m_indexCount == capacity) {
+				capacity = capacity ? capacity * 2 : 16;
+				r->m_indexBlocks = realloc(r->m_indexBlocks, capacity * sizeof(*r->m_indexBlocks));
+			}
+
+			r->m_indexBlocks[r->m_indexCount++] = offset;
+			r->m_tailCount = 0;
+		}
+		else if((h.m_magic == LOG_DATA_MAGIC) && (r->m_tailCount < LOG_INDEX_INTERVAL)) {
+			r->m_tail[r->m_tailCount].m_firstMs = h.m_firstMs;
+			r->m_tail[r->m_tailCount].m_offset = offset;
+			r->m_tailCount++;
+		}
+		else {
+			break;
+		}
+
+		offset += LOG_BLOCK_HEADER_SIZE + h.m_length;
+	}
+
+	return true;
+}
+
+// Copy out the header at offset, if a block with that magic fits in the file there.
+static bool block_at(const replay* r, uint64_t offset, uint32_t magic, log_block_header* h) {
+
+	if((offset < LOG_FILE_HEADER_SIZE) || (offset + LOG_BLOCK_HEADER_SIZE > r->m_size)) {
+		return false;
+	}
+
+	sessionlog_get_block_header(r->m_map + offset, h);
+
+	if((h->m_magic != magic) || (offset + LOG_BLOCK_HEADER_SIZE + h->m_length > r->m_size)) {
+		return false;
+	}
+
+	// an index block must hold at least one entry, and no more than its length covers
+	if((magic == LOG_INDEX_MAGIC) && ((h->m_count == 0) || (h->m_count > h->m_length / LOG_INDEX_ENTRY_SIZE))) {
+		return false;
+	}
+
+	return true;
+}
+
+// Entry i of the index block at indexOffset, which block_at() has already accepted.
+static log_index_entry index_entry(const replay* r, uint64_t indexOffset, uint32_t i) {
+	log_index_entry e;
+
+	sessionlog_get_index_entry(r->m_map + indexOffset + LOG_BLOCK_HEADER_SIZE + i * LOG_INDEX_ENTRY_SIZE, &e);
+
+	return e;
+}
+
+// Offset of the last data block starting at or before logMs (or the first block).
+static uint64_t find_block(const replay* r, uint64_t logMs) {
+	uint64_t ib = 0;	// 0 while searching the tail
+	uint32_t lo, hi, count;
+
+	if((r->m_tailCount > 0) && ((r->m_indexCount == 0) || (r->m_tail[0].m_firstMs <= logMs))) {
+		count = r->m_tailCount;
+	}
+	else {
+		lo = 0;
+		hi = r->m_indexCount;
+
+		while(hi - lo > 1) {
+			uint32_t mid = (lo + hi) / 2;
+
+			if(index_entry(r, r->m_indexBlocks[mid], 0).m_firstMs <= logMs) {
+				lo = mid;
+			}
+			else {
+				hi = mid;
+			}
+		}
+
+		log_block_header ih;
+
+		ib = r->m_indexBlocks[lo];
+		block_at(r, ib, LOG_INDEX_MAGIC, &ih);
+		count = ih.m_count;
+	}
+
+	lo = 0;
+	hi = count;
+
+	while(hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if((ib ? index_entry(r, ib, mid) : r->m_tail[mid]).m_firstMs <= logMs) {
+			lo = mid;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return (ib ? index_entry(r, ib, lo) : r->m_tail[lo]).m_offset;
+}
+
+static void load_block(replay* r, uint64_t offset) {
+	replay_block* b = &r->m_block;
+	log_block_header* h = &b->m_header;
+	const uint8_t* p;
+	uint64_t t;
+	uint32_t i;
+
+	r->m_atEnd = true;
+
+	if(! block_at(r, offset, LOG_DATA_MAGIC, h) || (h->m_count == 0) || (h->m_count > LOG_BLOCK_GROUPS)) {
+		return;
+	}
+
+	b->m_offset = offset;
+	p = r->m_map + offset + LOG_BLOCK_HEADER_SIZE;
+	b->m_end = p + h->m_length;
+	t = h->m_firstMs;
+
+	for(i = 0; (i < h->m_count) && p; i++) {
+		uint32_t delta;
+
+		p = sample_get_varint(p, b->m_end, &delta);
+		t += sample_unzigzag(delta);
+		b->m_times[i] = t;
+	}
+
+	for(i = 0; (i < h->m_count) && p; i++) {
+		p = sample_get_varint(p, b->m_end, &b->m_masks[i]);
+	}
+
+	if(! p) {
+		return;
+	}
+
+	b->m_values = p;
+	b->m_group = 0;
+	memset(b->m_prev, 0, sizeof(b->m_prev));
+
+	r->m_atEnd = false;
+
+}
+
+static void next_block(replay* r) {
+	uint64_t offset = r->m_block.m_offset + LOG_BLOCK_HEADER_SIZE + r->m_block.m_header.m_length;
+	log_block_header h;
+
+	// index blocks sit between data blocks; step over them
+	while(block_at(r, offset, LOG_INDEX_MAGIC, &h)) {
+		offset += LOG_BLOCK_HEADER_SIZE + h.m_length;
+	}
+
+	load_block(r, offset);
+
+}
+
+static bool apply_group(replay* r, ecu_data* dat) {
+	replay_block* b = &r->m_block;
+	uint32_t mask = b->m_masks[b->m_group];
+	int type;
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		int i, n;
+
+		if(! (mask & (1u << type))) {
+			continue;
+		}
+
+		n = sample_value_count(type);
+
+		for(i = 0; i < n; i++) {
+			uint32_t delta;
+
+			if(! (b->m_values = sample_get_varint(b->m_values, b->m_end, &delta))) {
+				r->m_atEnd = true;
+				return false;
+			}
+
+			b->m_prev[type][i] += sample_unzigzag(delta);
+		}
+
+		sample_decode(dat, type, b->m_prev[type]);
+	}
+
+	dat->m_sampled |= mask;
+
+	if(++b->m_group == b->m_header.m_count) {
+		next_block(r);
+	}
+
+	return true;
+}
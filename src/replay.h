@@ -0,0 +1,51 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "sessionlog.h"
+
+// Playback speed is held in quarters: 1 = 0.25x ... 256 = 64x.
+#define REPLAY_SPEED_MIN	1
+#define REPLAY_SPEED_NORMAL	4
+#define REPLAY_SPEED_MAX	256
+
+typedef struct replay_block {
+	log_block_header m_header;
+	uint64_t m_offset;
+	uint64_t m_times[LOG_BLOCK_GROUPS];
+	uint32_t m_masks[LOG_BLOCK_GROUPS];
+	const uint8_t* m_values;
+	const uint8_t* m_end;
+	uint32_t m_group;
+	int32_t m_prev[SampleType_NumSampleTypes][SAMPLE_MAX_VALUES];
+	} replay_block;
+
+typedef struct replay {
+	const uint8_t* m_map;
+	size_t m_size;
+	uint64_t m_firstMs;
+	uint64_t m_lastMs;
+
+	// offsets of the index blocks in file order, plus data blocks written after the last one
+	uint64_t* m_indexBlocks;
+	uint32_t m_indexCount;
+	log_index_entry m_tail[LOG_INDEX_INTERVAL];
+	uint32_t m_tailCount;
+
+	replay_block m_block;
+	bool m_atEnd;
+
+	uint64_t m_positionMs;
+	uint64_t m_anchorMs;
+	uint32_t m_speed;
+	bool m_paused;
+	bool m_pausedAtEnd;	// paused by reaching the end rather than by the user
+	} replay;
+
+extern replay* replay_open(const char* path);
+extern void replay_close(replay* r);
+extern read_result replay_advance(replay* r, ecu_data* dat, uint64_t nowMs);
+extern void replay_seek(replay* r, ecu_data* dat, uint64_t logMs, uint64_t nowMs);
+extern void replay_set_speed(replay* r, uint32_t speed, uint64_t nowMs);
+extern void replay_set_paused(replay* r, bool paused, uint64_t nowMs);
+
+#endif
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "romcache.h"
+
+/*
+ * The tune ROM never changes for a given tune/ident/checksum fixer, so it
+ * is fetched once and kept on disk. Until a cached copy turns up the dump
+ * runs in the background, as many chunks per read_data() pass as the
+ * caller allows, so polling carries on throughout.
+ *
+ * A finished dump is only kept if its bytes add up to CUX_ROM_CHECKSUM, as
+ * every tune ROM's do. One that does not is read again, up to
+ * ROM_MAX_DUMPS times in all; after that the cache gives up on this ECU
+ * rather than spend the spare serial time on dumps that never check out.
+ *
+ * Where the fuel maps sit inside the image is libcomm14cux's business, so
+ * they are read once each through c14cux_getFuelMap() after the image has
+ * checked out, and cached beside it. After that no further serial time is
+ * spent on them.
+ *
+ * Written only from the thread polling the connection; other threads may
+ * read the image and maps once romcache_state() reports romstate_ready.
+ */
+
+// The image, then for each map its adjustment factor (little-endian) and cells.
+#define CACHE_MAP_BYTES		(2 + FUEL_MAP_CELLS)
+#define CACHE_FILE_BYTES	(CUX_ROM_SIZE + FUEL_MAP_COUNT * CACHE_MAP_BYTES)
+
+static bool cache_path(const ecu_data* dat, char* path, size_t len);
+static bool load_cache(rom_cache* rc, const char* path);
+static void save_cache(const rom_cache* rc, const char* path);
+static bool checksum_ok(const rom_cache* rc);
+
+void romcache_reset(rom_cache* rc) {
+
+	rc->m_dumped = 0;
+	rc->m_badDumps = 0;
+	rc->m_mapsRead = 0;
+	rc->m_fromCache = false;
+	__atomic_store_n(&rc->m_state, romstate_waiting, __ATOMIC_RELEASE);
+
+}
+
+void romcache_lookup(rom_cache* rc, ecu_data* dat) {
+	char path[256];
+
+	// the cache is keyed on the tune, so nothing can happen until it has been read
+	if((rc->m_state != romstate_waiting) || ! dat->m_readTuneId) {
+		return;
+	}
+
+	if(cache_path(dat, path, sizeof(path)) && load_cache(rc, path)) {
+		rc->m_fromCache = true;
+		dat->m_romRead = true;
+		__atomic_store_n(&rc->m_state, romstate_ready, __ATOMIC_RELEASE);
+	}
+	else {
+		rc->m_dumped = 0;
+		rc->m_mapsRead = 0;
+		rc->m_state = romstate_dumping;
+	}
+
+}
+
+// Up to steps image chunks, or one fuel map if steps is not 0.
+read_result romcache_poll(rom_cache* rc, c14cux_info* info, ecu_data* dat, int steps) {
+	read_result result = readresult_nostatement;
+	char path[256];
+	int i;
+
+	if(rc->m_state == romstate_dumping) {
+		for(i = 0; (i < steps) && (rc->m_dumped < CUX_ROM_SIZE); i++) {
+			if(! c14cux_readMem(info, CUX_ROM_BASE + rc->m_dumped, ROM_CHUNK, &rc->m_image[rc->m_dumped])) {
+				result = readresult_failure;
+				break;
+			}
+
+			__atomic_store_n(&rc->m_dumped, rc->m_dumped + ROM_CHUNK, __ATOMIC_RELAXED);
+			result = readresult_success;
+		}
+
+		if(rc->m_dumped < CUX_ROM_SIZE) {
+			return result;
+		}
+
+		if(checksum_ok(rc)) {
+			rc->m_state = romstate_maps;
+		}
+		else if(++rc->m_badDumps < ROM_MAX_DUMPS) {
+			// a garbled dump would be cached forever; start again
+			__atomic_store_n(&rc->m_dumped, 0, __ATOMIC_RELAXED);
+		}
+		else {
+			__atomic_store_n(&rc->m_state, romstate_failed, __ATOMIC_RELEASE);
+		}
+
+		return (rc->m_state == romstate_maps) ? result : readresult_failure;
+	}
+
+	if((rc->m_state != romstate_maps) || (steps == 0)) {
+		return result;
+	}
+
+	if(! c14cux_getFuelMap(info, rc->m_mapsRead, &rc->m_adjustments[rc->m_mapsRead], rc->m_maps[rc->m_mapsRead])) {
+		return readresult_failure;
+	}
+
+	__atomic_store_n(&rc->m_mapsRead, rc->m_mapsRead + 1, __ATOMIC_RELAXED);
+
+	if(rc->m_mapsRead == FUEL_MAP_COUNT) {
+		if(cache_path(dat, path, sizeof(path))) {
+			save_cache(rc, path);
+		}
+
+		dat->m_romRead = true;
+		__atomic_store_n(&rc->m_state, romstate_ready, __ATOMIC_RELEASE);
+	}
+
+	return readresult_success;
+}
+
+rom_state romcache_state(const rom_cache* rc) {
+	return __atomic_load_n(&rc->m_state, __ATOMIC_ACQUIRE);
+}
+
+// Counted in transactions: every chunk of the image, then every map.
+unsigned int romcache_progress(const rom_cache* rc) {
+	unsigned int done = __atomic_load_n(&rc->m_dumped, __ATOMIC_RELAXED) / ROM_CHUNK + __atomic_load_n(&rc->m_mapsRead, __ATOMIC_RELAXED);
+
+	return done * 100 / (CUX_ROM_SIZE / ROM_CHUNK + FUEL_MAP_COUNT);
+}
+
+unsigned int romcache_bad_dumps(const rom_cache* rc) {
+	return rc->m_badDumps;
+}
+
+bool romcache_from_cache(const rom_cache* rc) {
+	return rc->m_fromCache;
+}
+
+bool romcache_fuel_map(const rom_cache* rc, uint8_t index, uint8_t* cells, uint16_t* adjustment) {
+
+	if((romcache_state(rc) != romstate_ready) || (index >= FUEL_MAP_COUNT)) {
+		return false;
+	}
+
+	memcpy(cells, rc->m_maps[index], FUEL_MAP_CELLS);
+
+	if(adjustment) {
+		*adjustment = rc->m_adjustments[index];
+	}
+
+	return true;
+}
+
+static bool cache_path(const ecu_data* dat, char* path, size_t len) {
+	const char* home = getenv("HOME");
+
+	if(! home) {
+		return false;
+	}
+
+	snprintf(path, len, "%s/%s", home, ROM_CACHE_DIR);
+	mkdir(path, 0755);
+
+	return snprintf(path, len, "%s/%s/rom-%04x-%04x-%02x.bin", home, ROM_CACHE_DIR, dat->m_tune, dat->m_ident, dat->m_checksumFixer) < len;
+}
+
+// Only a file of exactly the right size whose image passes the checksum is used.
+static bool load_cache(rom_cache* rc, const char* path) {
+	uint8_t maps[FUEL_MAP_COUNT * CACHE_MAP_BYTES + 1];
+	FILE* f = fopen(path, "rb");
+	size_t got;
+	int i;
+
+	if(! f) {
+		return false;
+	}
+
+	got = fread(rc->m_image, 1, CUX_ROM_SIZE, f);
+	got += fread(maps, 1, sizeof(maps), f);
+	fclose(f);
+
+	if((got != CACHE_FILE_BYTES) || ! checksum_ok(rc)) {
+		return false;
+	}
+
+	for(i = 0; i < FUEL_MAP_COUNT; i++) {
+		const uint8_t* p = &maps[i * CACHE_MAP_BYTES];
+
+		rc->m_adjustments[i] = p[0] | (p[1] << 8);
+		memcpy(rc->m_maps[i], p + 2, FUEL_MAP_CELLS);
+	}
+
+	return true;
+}
+
+// Write beside the final name and rename, so a partial file is never picked up.
+static void save_cache(const rom_cache* rc, const char* path) {
+	uint8_t maps[FUEL_MAP_COUNT * CACHE_MAP_BYTES];
+	char tmp[264];
+	FILE* f;
+	bool ok;
+	int i;
+
+	for(i = 0; i < FUEL_MAP_COUNT; i++) {
+		uint8_t* p = &maps[i * CACHE_MAP_BYTES];
+
+		p[0] = rc->m_adjustments[i] & 0xff;
+		p[1] = rc->m_adjustments[i] >> 8;
+		memcpy(p + 2, rc->m_maps[i], FUEL_MAP_CELLS);
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "wb");
+
+	if(! f) {
+		return;
+	}
+
+	ok = (fwrite(rc->m_image, 1, CUX_ROM_SIZE, f) == CUX_ROM_SIZE) && (fwrite(maps, 1, sizeof(maps), f) == sizeof(maps));
+
+	if((fclose(f) == 0) && ok) {
+		rename(tmp, path);
+	}
+	else {
+		unlink(tmp);
+	}
+
+}
+
+static bool checksum_ok(const rom_cache* rc) {
+	uint8_t sum = 0;
+	int i;
+
+	for(i = 0; i < CUX_ROM_SIZE; i++) {
+		sum += rc->m_image[i];
+	}
+
+	return sum == CUX_ROM_CHECKSUM;
+}
@@ -0,0 +1,50 @@
+#ifndef ROMCACHE_H
+#define ROMCACHE_H
+
+#include "cuxinterface.h"
+#include "cuxmemory.h"
+
+// Cache files live in $HOME/ROM_CACHE_DIR, one per tune/ident/checksum fixer.
+#define ROM_CACHE_DIR		".roverdisplay"
+#define ROM_CHUNK		16
+// Dump chunks read per read_data() pass at most, if the tick has serial time left for them.
+#define ROM_CHUNKS_PER_PASS	2
+#define ROM_CHUNK_COST_US	((SCHED_CMD_BYTES + ROM_CHUNK) * SCHED_BYTE_US)
+// Roughly what one c14cux_getFuelMap() costs: the cells and the adjustment factor. One per pass at most.
+#define ROM_MAP_COST_US		((SCHED_CMD_BYTES + FUEL_MAP_CELLS + 2) * SCHED_BYTE_US)
+// Passes a dump may be crowded out of altogether before it reads a chunk regardless.
+#define ROM_MAX_SKIPPED_PASSES	5
+// Dumps that fail the checksum before the cache gives up on this ECU.
+#define ROM_MAX_DUMPS		3
+
+#define FUEL_MAP_CELLS		(CUX_FUEL_MAP_ROWS * CUX_FUEL_MAP_COLUMNS)
+
+typedef enum rom_state {
+	romstate_waiting,
+	romstate_dumping,	// reading the image
+	romstate_maps,		// image checked, reading the fuel maps through libcomm14cux
+	romstate_ready,
+	romstate_failed		// ROM_MAX_DUMPS bad checksums; nothing ROM-resident is available
+	} rom_state;
+
+struct rom_cache {
+	uint8_t m_image[CUX_ROM_SIZE];
+	unsigned int m_dumped;
+	unsigned int m_badDumps;
+	uint8_t m_maps[FUEL_MAP_COUNT][FUEL_MAP_CELLS];
+	uint16_t m_adjustments[FUEL_MAP_COUNT];
+	unsigned int m_mapsRead;
+	rom_state m_state;
+	bool m_fromCache;
+	};
+
+extern void romcache_reset(rom_cache* rc);
+extern void romcache_lookup(rom_cache* rc, ecu_data* dat);
+extern read_result romcache_poll(rom_cache* rc, c14cux_info* info, ecu_data* dat, int steps);
+extern rom_state romcache_state(const rom_cache* rc);
+extern unsigned int romcache_progress(const rom_cache* rc);
+extern unsigned int romcache_bad_dumps(const rom_cache* rc);
+extern bool romcache_from_cache(const rom_cache* rc);
+extern bool romcache_fuel_map(const rom_cache* rc, uint8_t index, uint8_t* cells, uint16_t* adjustment);
+
+#endif
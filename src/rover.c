@@ -18,14 +18,25 @@
  */
 
 #include <stdio.h>
-#include <curses.h>
-#include <panel.h>
+#include <stdlib.h>
+#include <string.h>
 #include <signal.h>
+#include <pthread.h>
 #include <unistd.h>
-#include <sys/time.h>
-#include <aio.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
 
 #include "cuxinterface.h"
+#include "acquisition.h"
+#include "replay.h"
+#include "telemetry.h"
+#include "stream.h"
+#include "romcache.h"
+#include "render.h"
+#include "derived.h"
+#include "history.h"
 
 #define STR_INDIR(x) #x
 #define STR(x) STR_INDIR(x)
@@ -39,110 +50,277 @@
 #define ROWS	15
 #define COLS	80
 #define FLEN	6
-
-#define REFRESH	200
+#define NUMLEN	16
+
+#define REFRESH	POLL_PERIOD_MS
+#define EVENTS	8
+
+// graph page: value labels to the left of the plot, time axis below it
+#define GRAPH_LEFT	9
+#define GRAPH_TOP	2
+#define GRAPH_WIDTH	(COLS - GRAPH_LEFT - 1)
+#define GRAPH_HEIGHT	(ROWS - 5)
+
+// fuel map page: row numbers to the left of the cells, the operating point below them
+#define FUEL_LEFT	5
+#define FUEL_TOP	3
+#define FUEL_CELL	4
+
+// Every value on the main screen, in the order update_data() draws them.
+enum field {
+	FIELD_HEARTBEAT,
+	FIELD_STATUS,
+	FIELD_MIL,
+	FIELD_FAULTS,
+	FIELD_RPM,
+	FIELD_COOLANT_TEMP,
+	FIELD_ROAD_SPEED,
+	FIELD_FUEL_TEMP,
+	FIELD_MAF,
+	FIELD_THROTTLE,
+	FIELD_RPM_LIMIT,
+	FIELD_IDLE_BYPASS,
+	FIELD_IDLE_TARGET,
+	FIELD_LAMBDA_ODD,
+	FIELD_LAMBDA_EVEN,
+	FIELD_DUTY_CYCLE,
+	FIELD_PULSE_WIDTH,
+	FIELD_FUEL_FLOW,
+	FIELD_LAMBDA_AVG,
+	FIELD_MAIN_VOLTAGE,
+	FIELD_FUEL_PUMP
+	};
 
 void exit_handler(int signum);
-void alarm_handler(int signum);
-void io_handler(int signum);
+bool event_loop();
+void watch_fd(int ep, int fd);
 void do_layout();
 void update_data();
-void write_faults();
-void process_key();
-void setup_aio_buffer(struct aiocb *aio_buf);
+void update_faults(int row);
+void write_faults(const c14cux_faultcodes* fresh);
+void fault_line(int* row, bool set, bool fresh, const char* text);
+void stats_window();
+void derived_window();
+ecu_real derived_display(int ch, ecu_real value);
+void graph_window();
+int graph_points(history_point* out, int width);
+void fuel_window();
+void fuel_cell(int cell, int attr);
+void process_key(char c);
+void toggle_log();
+void replay_key(char c);
+void write_replay_status();
+int serve(const char* addr, const char* port, unsigned int options, const char* shmName);
+int headless(const char* port, stream_format format, unsigned int options, const char* shmName);
+bool ui_state_init(uint32_t windowMs, uint64_t startMs);
 
 ecu_data dat;
+cux_conn* ecu;
 bool metric;
-PANEL *mainp;
-PANEL *popupp;
-WINDOW *popupw;
+bool logging;
+replay* replayLog;
+telem_client* remote;
 
 volatile sig_atomic_t run;
-volatile sig_atomic_t alarm_flag;
-volatile sig_atomic_t io_flag;
+read_result remoteResult = readresult_nostatement;
+
+// derived channels as of the last tick; computed here only for replay and telemetry,
+// the acquisition thread keeps its own, so this is only allocated in those modes
+derived_state* uiDerived;
+derived_summary derivedNow[derived_count];
+
+// fault codes as of the last time the codes popup showed them; anything set since is new
+c14cux_faultcodes faultsSeen;
+
+// likewise the history behind the graph page
+history* uiHistory;
+
+// what the graph page shows, and whether it is up (and so redrawn every tick)
+bool graphShown;
+SampleType graphType = SampleType_EngineRPM;
+int graphSpan;
+const uint32_t graphSpansMs[] = { 10000, 60000, 600000, 3600000 };
+const char* const graphSpanNames[] = { "10 s", "1 min", "10 min", "60 min" };
+
+// the fuel map page: which map its grid shows (-1 for none yet), and the cells marked as in use
+bool fuelShown;
+int fuelDrawnMap = -1;
+uint8_t fuelCells[FUEL_MAP_CELLS];
+int fuelMarks[4];
+int fuelMarkCount;
 
-struct aiocb kbcbuf;
+// how late each display tick was handled; a tick that swallowed missed ones counts as a failure
+latency_hist tickJitter;
 
 int main(int argc, char** argv) {
-	struct sigaction handler;
-	sigset_t blocked;
-	struct itimerval itimer;
+	bool measure = false;
+	unsigned int options = 0;
+	unsigned int decimation = 1;
+	const char* shmName = NULL;
+	shm_table* table = NULL;
+	bool streaming = false;
+	bool formatGiven = false;
+	stream_format format = streamformat_csv;
+	uint32_t windowMs = DERIVED_WINDOW_MS;
+
+	// leading options: --measure reports how much was written to the terminal on exit
+	while((argc > 1) && (strncmp(argv[1], "--", 2) == 0) && (strcmp(argv[1], "--replay") != 0)) {
+		if(strcmp(argv[1], "--measure") == 0) {
+			measure = true;
+		}
+		else if(strcmp(argv[1], "--adaptive") == 0) {
+			options |= CUX_OPT_ADAPTIVE;
+		}
+		else if(strcmp(argv[1], "--headless") == 0) {
+			streaming = true;
+		}
+		else if(strncmp(argv[1], "--format=", 9) == 0) {
+			if(! stream_parse_format(argv[1] + 9, &format)) {
+				fprintf(stderr, "Unknown format %s; use csv, jsonl or bin.\n", argv[1] + 9);
+				return 1;
+			}
 
-	itimer.it_value.tv_sec = REFRESH / 1000;
-	itimer.it_value.tv_usec = 1000*(REFRESH % 1000);
-	itimer.it_interval.tv_sec = REFRESH / 1000;
-	itimer.it_interval.tv_usec = 1000*(REFRESH % 1000);
+			formatGiven = true;
+		}
+		else if((strcmp(argv[1], "--window") == 0) && (argc > 2)) {
+			windowMs = atoi(argv[2]);
+			argc--;
+			argv++;
+		}
+		else if((strcmp(argv[1], "--shm") == 0) && (argc > 2)) {
+			shmName = argv[2];
+			argc--;
+			argv++;
+		}
+		else if((strcmp(argv[1], "--decimate") == 0) && (argc > 2)) {
+			decimation = atoi(argv[2]);
+			argc--;
+			argv++;
+		}
+		else {
+			break;
+		}
 
-	handler.sa_handler = alarm_handler;
-	handler.sa_flags = SA_RESTART;
-	sigemptyset(&blocked);
-	handler.sa_mask = blocked;
+		argc--;
+		argv++;
+	}
 
-	if(sigaction(SIGALRM, &handler, NULL) == -1) {
-		perror("Couldn't install update handler");
+	if(formatGiven && ! streaming) {
+		fprintf(stderr, "--format only applies to --headless.\n");
+		return 1;
 	}
 
-	handler.sa_handler = io_handler;
+	if((argc == 3) && (strcmp(argv[1], "--replay") == 0)) {
+		replayLog = replay_open(argv[2]);
+
+		if(! replayLog) {
+			fprintf(stderr, "Could not open session log %s.\n", argv[2]);
+			return 1;
+		}
+
+		replay_seek(replayLog, &dat, replayLog->m_firstMs, monotonic_us() / 1000);
 
-	if(sigaction(SIGIO, &handler, NULL) == -1) {
-        	perror("Couldn't install AIO handler");
+		if(! ui_state_init(windowMs, replayLog->m_firstMs)) {
+			fprintf(stderr, "Out of memory.\n");
+			return 1;
+		}
+	}
+	else if((argc == 2) && streaming) {
+		return headless(argv[1], format, options, shmName);
+	}
+	else if((argc == 4) && (strcmp(argv[1], "--serve") == 0)) {
+		return serve(argv[2], argv[3], options, shmName);
 	}
+	else if((argc == 3) && (strcmp(argv[1], "--connect") == 0)) {
+		remote = telem_client_open(argv[2], TELEM_ALL_CHANNELS, decimation);
 
-	if(argc != 2) {
-		printf("Usage: roverdisplay <port>, e.g. roverdisplay /dev/ttyS0\n");
-		return 1;
+		if(! remote) {
+			fprintf(stderr, "Could not connect to telemetry server %s.\n", argv[2]);
+			return 1;
+		}
+
+		if(! ui_state_init(windowMs, monotonic_us() / 1000)) {
+			fprintf(stderr, "Out of memory.\n");
+			return 1;
+		}
 	}
+	else if(argc == 2) {
+		ecu = connect_to_ecu(&dat, argv[1], options);
 
-	bool res = connect_to_ecu(&dat, argv[1]);
-	
-	if(! res) {
-		fprintf(stderr, "Could not open serial port.\n");
+		if(! ecu) {
+			fprintf(stderr, "Could not open serial port.\n");
+			return 1;
+		}
+
+		if(shmName && ! (table = shmtable_create(shmName))) {
+			fprintf(stderr, "Could not create shared memory table %s.\n", shmName);
+			return 1;
+		}
+
+		acquisition_set_table(table);
+		acquisition_set_window(windowMs);
+
+		if(! acquisition_start(ecu, &dat)) {
+			fprintf(stderr, "Could not start acquisition thread.\n");
+			return 1;
+		}
+	}
+	else {
+		printf("Usage: roverdisplay [--measure] [--adaptive] [--window <ms>] [--shm <name>] <port>, e.g. roverdisplay /dev/ttyS0\n"
+		       "       roverdisplay [--measure] [--window <ms>] --replay <log.rdl>\n"
+		       "       roverdisplay [--adaptive] [--shm <name>] --serve <socket|tcp:port> <port>\n"
+		       "       roverdisplay [--adaptive] [--shm <name>] --headless [--format=csv|jsonl|bin] <port>\n"
+		       "       roverdisplay [--measure] [--window <ms>] [--decimate <n>] --connect <socket|tcp:port>\n");
 		return 1;
 	}
 
 	run = 1;
 	metric = true;
 
-	setup_aio_buffer(&kbcbuf);
-	aio_read(&kbcbuf);
-	
-	sigaddset(&blocked, SIGALRM);
-	handler.sa_flags = 0;
-	handler.sa_handler = exit_handler;
-	if(sigaction(SIGINT, &handler, NULL) == -1) {
-                perror("Couldn't install exit handler");
-        }
-
-	initscr();
-	cbreak();
-	clear();
-	curs_set(0);
+	if(! render_begin(measure)) {
+		fprintf(stderr, "Could not open terminal.\n");
+		return 1;
+	}
 
-	mainp = new_panel(stdscr);
-	popupw = newwin(ROWS - 1, COLS, 1, 0);
-	popupp = new_panel(popupw);
-	hide_panel(popupp);
+	render_popup_init(1, ROWS - 1, COLS);
 
 	do_layout();
 
-	setitimer(ITIMER_REAL, &itimer, NULL);
+	if(! event_loop()) {
+		render_end();
+		perror("Could not set up the event loop");
+		return 1;
+	}
+
+	render_end();
 
-	while(run) {
-		if(alarm_flag) {
-			update_data();
-			alarm_flag = 0;
-		}
-		else if(io_flag) {
-			process_key();
-			io_flag = 0;
+	if(replayLog) {
+		replay_close(replayLog);
+	}
+	else if(remote) {
+		telem_client_close(remote);
+	}
+	else {
+		if(logging) {
+			toggle_log();
 		}
-		else {
-			pause();
+
+		acquisition_stop();
+
+		if(table) {
+			shmtable_close(table);
 		}
+
+		print_poll_stats(ecu, stdout);
+		print_latency(ecu, stdout);
+		disconnect_from_ecu(ecu);
 	}
 
-	echo();
-	endwin();
+	free(uiDerived);
+	free(uiHistory);
+
+	print_render_stats(stdout);
+	latency_print(stdout, "Display tick lateness", &tickJitter);
 
 	printf("RoverDisplay - goodbye.\n");
 
@@ -150,108 +328,219 @@ int main(int argc, char** argv) {
 }
 
 void exit_handler(int signum) {
-	struct sigaction cancel_sigalrm;
-	cancel_sigalrm.sa_handler = SIG_IGN;
-	cancel_sigalrm.sa_flags = 0;
-	sigemptyset(&cancel_sigalrm.sa_mask);
+	run = 0;
+	return;
+}
 
-	sigaction(SIGALRM, &cancel_sigalrm, NULL);
+/*
+ * Everything the screen waits on is a descriptor in one epoll set: the
+ * display tick (timerfd, on an absolute schedule so lateness never
+ * accumulates), SIGINT/SIGTERM (signalfd), key presses on stdin and, as a
+ * telemetry client, the server socket. Nothing is lost between checking
+ * for work and going to sleep, because there are no flags to check.
+ */
+bool event_loop() {
+	struct epoll_event events[EVENTS];
+	struct itimerspec period;
+	uint64_t firstUs, ticks = 0;
+	sigset_t quit;
+	int ep, tfd, sfd;
+
+	sigemptyset(&quit);
+	sigaddset(&quit, SIGINT);
+	sigaddset(&quit, SIGTERM);
+	// the acquisition thread already blocks everything, so this is the only thread they could reach
+	pthread_sigmask(SIG_BLOCK, &quit, NULL);
+
+	ep = epoll_create1(EPOLL_CLOEXEC);
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	sfd = signalfd(-1, &quit, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	if((ep < 0) || (tfd < 0) || (sfd < 0)) {
+		if(ep >= 0) close(ep);
+		if(tfd >= 0) close(tfd);
+		if(sfd >= 0) close(sfd);
+		return false;
+	}
 
-	run = 0;
+	// monotonic_us() runs on CLOCK_MONOTONIC too, so deadlines and lateness share a clock
+	firstUs = monotonic_us() + REFRESH * 1000;
+	period.it_value.tv_sec = firstUs / 1000000;
+	period.it_value.tv_nsec = (firstUs % 1000000) * 1000;
+	period.it_interval.tv_sec = REFRESH / 1000;
+	period.it_interval.tv_nsec = (REFRESH % 1000) * 1000000;
+	timerfd_settime(tfd, TFD_TIMER_ABSTIME, &period, NULL);
+
+	watch_fd(ep, tfd);
+	watch_fd(ep, sfd);
+	watch_fd(ep, STDIN_FILENO);
+
+	if(remote) {
+		watch_fd(ep, remote->m_fd);
+	}
+
+	latency_reset(&tickJitter);
+
+	while(run) {
+		int n = epoll_wait(ep, events, EVENTS, -1);
+		int i;
+
+		for(i = 0; i < n; i++) {
+			int fd = events[i].data.fd;
+
+			if(fd == tfd) {
+				uint64_t expired;
+
+				if(read(tfd, &expired, sizeof(expired)) == sizeof(expired)) {
+					ticks += expired;
+					latency_record(&tickJitter, monotonic_us() - (firstUs + (ticks - 1) * REFRESH * 1000), expired == 1);
+					update_data();
+				}
+			}
+			else if(fd == sfd) {
+				struct signalfd_siginfo info;
+
+				while(read(sfd, &info, sizeof(info)) == sizeof(info)) {
+					run = 0;
+				}
+			}
+			else if(fd == STDIN_FILENO) {
+				char c;
+
+				if(read(STDIN_FILENO, &c, 1) == 1) {
+					process_key(c);
+				}
+				else {
+					// end of input: stop listening rather than wake forever
+					epoll_ctl(ep, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+				}
+			}
+			else if(remote) {
+				read_result received = telem_client_read(remote, &dat);
+
+				if(received != readresult_nostatement) {
+					remoteResult = received;
+					derived_update(uiDerived, monotonic_us() / 1000, &dat);
+					history_add(uiHistory, monotonic_us() / 1000, &dat);
+				}
+			}
+		}
+	}
+
+	close(sfd);
+	close(tfd);
+	close(ep);
+
+	return true;
+}
+
+void watch_fd(int ep, int fd) {
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
 
-	return;
 }
 
 void do_layout() {
 	int row = 0;
 
-	mvprintw(row, COL2 - 6, "RoverDisplay");
+	render_text(row, COL2 - 6, RENDER_NORMAL, "RoverDisplay");
 	row++;
-	mvprintw(row, COL1, "MIL:");
+	render_text(row, COL1, RENDER_NORMAL, "MIL:");
+	render_text(row, COL2, RENDER_NORMAL, "Fault codes:");
 	row++;
-	mvprintw(row, COL1, "Engine speed:");
-	mvprintw(row, COL1_U, "rpm");
-	mvprintw(row, COL2, "Engine temperature:");
-	mvprintw(row, COL2_U, metric ? "degC" : "degF");
+	render_text(row, COL1, RENDER_NORMAL, "Engine speed:");
+	render_text(row, COL1_U, RENDER_NORMAL, "rpm");
+	render_text(row, COL2, RENDER_NORMAL, "Engine temperature:");
+	render_text(row, COL2_U, RENDER_NORMAL, metric ? "degC" : "degF");
 	row++;
-	mvprintw(row, COL1, "Road speed:");
-	mvprintw(row, COL1_U, metric ? "km/h" : "mph ");
-	mvprintw(row, COL2, "Fuel temperature:");
-	mvprintw(row, COL2_U, metric ? "degC" : "degF");
+	render_text(row, COL1, RENDER_NORMAL, "Road speed:");
+	render_text(row, COL1_U, RENDER_NORMAL, metric ? "km/h" : "mph ");
+	render_text(row, COL2, RENDER_NORMAL, "Fuel temperature:");
+	render_text(row, COL2_U, RENDER_NORMAL, metric ? "degC" : "degF");
 	row++;
 	row++;
-	mvprintw(row, COL1, "MAF:");
-	mvprintw(row, COL1_U, "%%");
+	render_text(row, COL1, RENDER_NORMAL, "MAF:");
+	render_text(row, COL1_U, RENDER_NORMAL, "%%");
 	row++;
-	mvprintw(row, COL1, "Throttle:");
-	mvprintw(row, COL1_U, "%%");
-	mvprintw(row, COL2, "Rev limit:");
-	mvprintw(row, COL2_U, "rpm");
+	render_text(row, COL1, RENDER_NORMAL, "Throttle:");
+	render_text(row, COL1_U, RENDER_NORMAL, "%%");
+	render_text(row, COL2, RENDER_NORMAL, "Rev limit:");
+	render_text(row, COL2_U, RENDER_NORMAL, "rpm");
 	row++;
-	mvprintw(row, COL1, "Idle bypass:");
-	mvprintw(row, COL1_U, "%%");
-	mvprintw(row, COL2, "Idle target:");
-	mvprintw(row, COL2_U, "rpm");
+	render_text(row, COL1, RENDER_NORMAL, "Idle bypass:");
+	render_text(row, COL1_U, RENDER_NORMAL, "%%");
+	render_text(row, COL2, RENDER_NORMAL, "Idle target:");
+	render_text(row, COL2_U, RENDER_NORMAL, "rpm");
 	row++;
 	row++;
-	mvprintw(row, COL1, "Lambda trim (odd):");
-	mvprintw(row, COL1_U, "%%");
-	mvprintw(row, COL2, "Lamba trim (even):");
-	mvprintw(row, COL2_U, "%%");
+	render_text(row, COL1, RENDER_NORMAL, "Lambda trim (odd):");
+	render_text(row, COL1_U, RENDER_NORMAL, "%%");
+	render_text(row, COL2, RENDER_NORMAL, "Lamba trim (even):");
+	render_text(row, COL2_U, RENDER_NORMAL, "%%");
 	row++;
-	mvprintw(row, COL1, "Injector duty cycle:");
-	mvprintw(row, COL1_U, "%%");
-	mvprintw(row, COL2, "Pulse width:");
-	mvprintw(row, COL2_U, "ms");
+	render_text(row, COL1, RENDER_NORMAL, "Injector duty cycle:");
+	render_text(row, COL1_U, RENDER_NORMAL, "%%");
+	render_text(row, COL2, RENDER_NORMAL, "Pulse width:");
+	render_text(row, COL2_U, RENDER_NORMAL, "ms");
 	row++;
+	render_text(row, COL1, RENDER_NORMAL, "Fuel flow (est):");
+	render_text(row, COL1_U, RENDER_NORMAL, "l/h");
+	render_text(row, COL2, RENDER_NORMAL, "Lambda trim (avg):");
+	render_text(row, COL2_U, RENDER_NORMAL, "%%");
 	row++;
-	mvprintw(row, COL1, "Main voltage:");
-	mvprintw(row, COL1_U, "V");
-	mvprintw(row, COL2, "Fuel pump relay:");
-
-	attron(A_REVERSE);
-	mvprintw(ROWS - 1, COL1, "U");
-	mvprintw(ROWS - 1, COL1 + 7, "C");
-	mvprintw(ROWS - 1, COL1 + 14, "F");
-	mvprintw(ROWS - 1, COL1 + 20, "L");
-	mvprintw(ROWS - 1, COL1 + 25, "I");
-	attroff(A_REVERSE);
-	mvprintw(ROWS - 1, COL1 + 1, "nits");
-	mvprintw(ROWS - 1, COL1 + 8, "odes");
-	mvprintw(ROWS - 1, COL1 + 15, "uel");
-	mvprintw(ROWS - 1, COL1 + 21, "og");
-	mvprintw(ROWS - 1, COL1 + 26, "nfo");
-
-	mvprintw(ROWS - 1, COLS - 1, " ");
-
-	update_panels();	
-	doupdate();
+	render_text(row, COL1, RENDER_NORMAL, "Main voltage:");
+	render_text(row, COL1_U, RENDER_NORMAL, "V");
+	render_text(row, COL2, RENDER_NORMAL, "Fuel pump relay:");
+
+	render_text(ROWS - 1, COL1, RENDER_REVERSE, "U");
+	render_text(ROWS - 1, COL1 + 7, RENDER_REVERSE, "C");
+	render_text(ROWS - 1, COL1 + 14, RENDER_REVERSE, "F");
+	render_text(ROWS - 1, COL1 + 20, RENDER_REVERSE, "L");
+	render_text(ROWS - 1, COL1 + 25, RENDER_REVERSE, "I");
+	render_text(ROWS - 1, COL1 + 30, RENDER_REVERSE, "S");
+	render_text(ROWS - 1, COL1 + 35, RENDER_REVERSE, "D");
+	render_text(ROWS - 1, COL1 + 1, RENDER_NORMAL, "nits");
+	render_text(ROWS - 1, COL1 + 8, RENDER_NORMAL, "odes");
+	render_text(ROWS - 1, COL1 + 15, RENDER_NORMAL, "uel");
+	render_text(ROWS - 1, COL1 + 21, logging ? RENDER_REVERSE : RENDER_NORMAL, "og");
+	render_text(ROWS - 1, COL1 + 26, RENDER_NORMAL, "nfo");
+	render_text(ROWS - 1, COL1 + 31, RENDER_NORMAL, "tats");
+	render_text(ROWS - 1, COL1 + 36, RENDER_NORMAL, "rv");
+
+	// the labels may have been redrawn over stale values, so let every field draw again
+	render_invalidate();
+	render_flush();
 
 	return;
 }
 
 void codes_window() {
-	read_result result;
-
-	wclear(popupw);
-	box(popupw, 0, 0);
-	wattron(popupw, A_REVERSE);
-	mvwprintw(popupw, ROWS - 2, 0, "Esc");
-	wattroff(popupw, A_REVERSE);
+	render_popup_clear();
+	render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
 
-	mvwprintw(popupw, 1, 1, "* ");
-
-	result = read_fault_codes(&dat);
-	if(result == readresult_failure) {
-		wprintw(popupw, "Read Err");
+	if(replayLog) {
+		render_popup_text(1, 1, RENDER_NORMAL, "* Fault codes are not recorded in session logs");
+	}
+	else if(remote) {
+		render_popup_text(1, 1, RENDER_NORMAL, "* Fault codes are not carried by the telemetry stream");
+	}
+	// straight from the background reads, so there is nothing to wait for
+	else if(! dat.m_faultsRead) {
+		render_popup_text(1, 1, RENDER_NORMAL, "* Fault codes have not been read yet");
 	}
 	else {
-		write_faults();
+		c14cux_faultcodes fresh;
+
+		fault_diff(&faultsSeen, &dat.m_faultCodes, &fresh);
+		write_faults(&fresh);
+		faultsSeen = dat.m_faultCodes;
 	}
 
-	show_panel(popupp);
-	update_panels();	
-	doupdate();
+	render_popup_show(true);
+	render_flush();
 	
 	return;
 
@@ -259,161 +548,525 @@ void codes_window() {
 
 
 void info_window() {
-	wclear(popupw);
-	box(popupw, 0, 0);
-	wattron(popupw, A_REVERSE);
-	mvwprintw(popupw, ROWS - 2, 0, "Esc");
-	wattroff(popupw, A_REVERSE);
+	const rom_cache* rom = ecu ? get_rom_cache(ecu) : NULL;
+
+	render_popup_clear();
+	render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
 
 	if(dat.m_readTuneId) {
-		mvwprintw(popupw, 1, 1, "* Tune: R%u", dat.m_tune);
-		mvwprintw(popupw, 2, 1, "* Ident: %x", dat.m_ident);
-		mvwprintw(popupw, 3, 1, "* Checksum fixer: %x", dat.m_checksumFixer);
+		render_popup_text(1, 1, RENDER_NORMAL, "* Tune: R%u", dat.m_tune);
+		render_popup_text(2, 1, RENDER_NORMAL, "* Ident: %x", dat.m_ident);
+		render_popup_text(3, 1, RENDER_NORMAL, "* Checksum fixer: %x", dat.m_checksumFixer);
+
+		if(replayLog) {
+			render_popup_text(4, 1, RENDER_NORMAL, "* ROM: not recorded in session logs");
+		}
+		else if(remote) {
+			render_popup_text(4, 1, RENDER_NORMAL, dat.m_romRead ? "* ROM: read by telemetry server" : "* ROM: not yet read by telemetry server");
+		}
+		else if(romcache_state(rom) == romstate_ready) {
+			render_popup_text(4, 1, RENDER_NORMAL, "* ROM: %s", romcache_from_cache(rom) ? "cached" : "dumped");
+		}
+		else if((romcache_state(rom) == romstate_dumping) || (romcache_state(rom) == romstate_maps)) {
+			render_popup_text(4, 1, RENDER_NORMAL, "* ROM: reading %u%%", romcache_progress(rom));
+		}
+		else if(romcache_state(rom) == romstate_failed) {
+			render_popup_text(4, 1, RENDER_NORMAL, "* ROM: checksum wrong on %u dumps, gave up", romcache_bad_dumps(rom));
+		}
+		else {
+			render_popup_text(4, 1, RENDER_NORMAL, "* ROM: not read");
+		}
 	}
 	else {
-		mvwprintw(popupw, 1, 1, "* Tune info not read from ECU");
+		render_popup_text(1, 1, RENDER_NORMAL, "* Tune info not read from ECU");
 	}
 
-	show_panel(popupp);
-	update_panels();	
-	doupdate();
+	render_popup_show(true);
+	render_flush();
 	
 	return;
 
 }
 
-void alarm_handler(int signum) {
-	alarm_flag = 1;
+// The slowest channels by p95 round trip, as of when the popup was opened.
+void stats_window() {
+	SampleType order[SampleType_NumSampleTypes];
+	latency_summary* sums;
+	latency_summary tick;
+	acq_stats stats;
+	int count = 0;
+	int i, j;
+
+	render_popup_clear();
+	render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
+
+	if(replayLog) {
+		render_popup_text(1, 1, RENDER_NORMAL, "* Link timing is not recorded in session logs");
+	}
+	else if(remote) {
+		render_popup_text(1, 1, RENDER_NORMAL, "* Link timing is reported by the telemetry server on exit");
+	}
+	else {
+		acquisition_stats(&stats);
+		sums = stats.m_latency;
+
+		for(i = 0; i < SampleType_NumSampleTypes; i++) {
+			if(stats.m_timed[i]) {
+				// insertion sort, slowest first
+				for(j = count; (j > 0) && (sums[order[j - 1]].m_p95Us < sums[i].m_p95Us); j--) {
+					order[j] = order[j - 1];
+				}
+
+				order[j] = i;
+				count++;
+			}
+		}
+
+		render_popup_text(1, 1, RENDER_NORMAL, "%-20s %7s %5s %8s %8s %8s %7s", "Channel", "Calls", "Fail", "p50", "p95", "Max", "Rate");
+
+		for(i = 0; (i < count) && (i < ROWS - 6); i++) {
+			latency_summary* sum = &sums[order[i]];
+			float rate = 0;
+
+			if(stats.m_polled[order[i]]) {
+				rate = stats.m_poll[order[i]].m_rateHz * (sum->m_count - sum->m_failures) / sum->m_count;
+			}
+
+			render_popup_text(i + 2, 1, RENDER_NORMAL, "%-20s %7u %5u %6.1fms %6.1fms %6.1fms %5.2fHz", sample_type_name(order[i]), sum->m_count, sum->m_failures, sum->m_p50Us / 1000.0, sum->m_p95Us / 1000.0, sum->m_maxUs / 1000.0, rate);
+		}
+
+		if(stats.m_link.m_outage.m_count > 0) {
+			render_popup_text(ROWS - 4, 1, RENDER_NORMAL, "Link: %u drops, longest outage %.1fs, full rate %.0fms after reconnecting", stats.m_link.m_drops, stats.m_link.m_outage.m_maxUs / 1e6, stats.m_link.m_resync.m_maxUs / 1e3);
+		}
+		else {
+			render_popup_text(ROWS - 4, 1, RENDER_NORMAL, "Link: %u drops", stats.m_link.m_drops);
+		}
+	}
+
+	latency_summarise(&tickJitter, &tick);
+	render_popup_text(ROWS - 3, 1, RENDER_NORMAL, "Ticks: %u, %u missed, lateness p50 %.2fms p95 %.2fms max %.2fms", tick.m_count, tick.m_failures, tick.m_p50Us / 1000.0, tick.m_p95Us / 1000.0, tick.m_maxUs / 1000.0);
+
+	render_popup_show(true);
+	render_flush();
+
 	return;
+
 }
 
-void io_handler(int signum) {
-	io_flag = 1;
+// Derived channels with their rolling window and peak hold, as of the last tick.
+void derived_window() {
+	int i;
+
+	render_popup_clear();
+	render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
+	render_popup_text(ROWS - 2, 5, RENDER_REVERSE, "P");
+	render_popup_text(ROWS - 2, 6, RENDER_NORMAL, "eak reset");
+
+	render_popup_text(1, 1, RENDER_NORMAL, "%-20s %9s %9s %9s %9s %9s", "Channel", "Now", "Min", "Mean", "Max", "Peak");
+
+	for(i = 0; i < derived_count; i++) {
+		derived_summary* sum = &derivedNow[i];
+		char now[NUMLEN], min[NUMLEN], mean[NUMLEN], max[NUMLEN], peak[NUMLEN];
+
+		if(sum->m_valid) {
+			render_popup_text(i + 2, 1, RENDER_NORMAL, "%-20s %9s %9s %9s %9s %9s", derived_name(i),
+					format_decimal(now, NUMLEN, ecu_scaled(derived_display(i, sum->m_value), DERIVED_ONE, 10), 1),
+					format_decimal(min, NUMLEN, ecu_scaled(derived_display(i, sum->m_min), DERIVED_ONE, 10), 1),
+					format_decimal(mean, NUMLEN, ecu_scaled(derived_display(i, sum->m_mean), DERIVED_ONE, 10), 1),
+					format_decimal(max, NUMLEN, ecu_scaled(derived_display(i, sum->m_max), DERIVED_ONE, 10), 1),
+					format_decimal(peak, NUMLEN, ecu_scaled(derived_display(i, sum->m_peak), DERIVED_ONE, 10), 1));
+		}
+		else {
+			render_popup_text(i + 2, 1, RENDER_NORMAL, "%-20s %9s", derived_name(i), "-");
+		}
+	}
+
+	render_popup_show(true);
+	render_flush();
+
 	return;
+
 }
 
-void update_data() {
-	int row;
-	read_result result;
+// Road speed goes to km/h when metric; 1.609344 is exactly 25146 / 15625.
+ecu_real derived_display(int ch, ecu_real value) {
 
-	if(run == 1) {
-		attron(A_REVERSE);
-		mvprintw(ROWS - 1, COLS - 1, " ");
-		run++;
+	if((ch == derived_roadspeed) && metric) {
+		return value * 25146 / 15625;
 	}
-	else {
-		mvprintw(ROWS - 1, COLS - 1, " ");
-		run = 1;
+
+	return value;
+}
+
+/*
+ * One channel over the chosen span. The history hands back at most one
+ * point per column whatever the span, so this costs the same every tick;
+ * render_popup_clear() rather than a full clear, so only what moved is sent.
+ */
+void graph_window() {
+	history_point points[GRAPH_WIDTH];
+	char plot[GRAPH_HEIGHT][GRAPH_WIDTH];
+	uint32_t spanMs = graphSpansMs[graphSpan];
+	int32_t scale = sample_value_scale(graphType, 0);
+	char label[NUMLEN];
+	int32_t lo, hi;
+	int n, i, y, prev = -1;
+	int decimals = 0;
+
+	// scales are powers of ten, so the encoded values print as they are
+	for(i = scale; i > 1; i /= 10) {
+		decimals++;
 	}
 
-	result = read_data(&dat);
+	render_popup_clear();
+	render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
+	render_popup_text(ROWS - 2, 5, RENDER_REVERSE, "G");
+	render_popup_text(ROWS - 2, 14, RENDER_REVERSE, "T");
+	render_popup_text(ROWS - 2, 6, RENDER_NORMAL, "raph");
+	render_popup_text(ROWS - 2, 15, RENDER_NORMAL, "ime");
 
-	attron(A_REVERSE);
+	n = graph_points(points, GRAPH_WIDTH);
+	render_popup_text(1, 1, RENDER_NORMAL, "%s (%s), last %s", sample_type_name(graphType), sample_value_name(graphType, 0), graphSpanNames[graphSpan]);
 
-	if(result == readresult_failure) {
-		mvprintw(ROWS - 1, COL2, "Read Err");
+	if(n == 0) {
+		render_popup_text(GRAPH_TOP + GRAPH_HEIGHT / 2, GRAPH_LEFT, RENDER_NORMAL, "* No samples yet");
+		render_popup_show(true);
+		return;
 	}
-	else {
-		mvprintw(ROWS - 1, COL2, "Read Ok ");
+
+	lo = hi = points[0].m_value;
+
+	for(i = 1; i < n; i++) {
+		if(points[i].m_value < lo) lo = points[i].m_value;
+		if(points[i].m_value > hi) hi = points[i].m_value;
+	}
+
+	memset(plot, ' ', sizeof(plot));
+
+	for(i = 0; i < n; i++) {
+		uint32_t age = points[n - 1].m_timeMs - points[i].m_timeMs;
+		int x = (age >= spanMs) ? 0 : (GRAPH_WIDTH - 1) - (int64_t)age * (GRAPH_WIDTH - 1) / spanMs;
+		int from, to;
+
+		y = (hi == lo) ? GRAPH_HEIGHT / 2 : (int64_t)(hi - points[i].m_value) * (GRAPH_HEIGHT - 1) / (hi - lo);
+
+		// join each point to the one before it with a vertical run
+		from = (prev < 0) ? y : (prev < y ? prev : y);
+		to = (prev < 0) ? y : (prev > y ? prev : y);
+
+		for(; from <= to; from++) {
+			plot[from][x] = (from == y) ? '*' : '|';
+		}
+
+		prev = y;
+	}
+
+	for(y = 0; y < GRAPH_HEIGHT; y++) {
+		render_popup_text(GRAPH_TOP + y, GRAPH_LEFT, RENDER_NORMAL, "%.*s", GRAPH_WIDTH, plot[y]);
+	}
+
+	render_popup_text(GRAPH_TOP, 1, RENDER_NORMAL, "%7s", format_decimal(label, NUMLEN, hi, decimals));
+	render_popup_text(GRAPH_TOP + GRAPH_HEIGHT - 1, 1, RENDER_NORMAL, "%7s", format_decimal(label, NUMLEN, lo, decimals));
+	render_popup_text(GRAPH_TOP + GRAPH_HEIGHT, GRAPH_LEFT, RENDER_NORMAL, "-%s", graphSpanNames[graphSpan]);
+	render_popup_text(GRAPH_TOP + GRAPH_HEIGHT, COLS - 5, RENDER_NORMAL, "now");
+
+	render_popup_show(true);
+
+	return;
+}
+
+// The live history belongs to the acquisition thread; replay and telemetry keep their own.
+int graph_points(history_point* out, int width) {
+
+	if(replayLog || remote) {
+		return history_graph(uiHistory, graphType, graphSpansMs[graphSpan], out, width);
+	}
+
+	return acquisition_graph(graphType, graphSpansMs[graphSpan], out, width);
+}
+
+/*
+ * The active fuel map, with the cells the ECU is interpolating between
+ * marked. The grid is drawn once, and again only if the ECU changes maps;
+ * after that each tick redraws just the cells whose marking changed and
+ * the operating point lines. Row and column weightings are in sixteenths
+ * towards the next row or column, so the interpolated value is a sum of
+ * cells weighted out of 256.
+ */
+void fuel_window() {
+	const rom_cache* rom = ecu ? get_rom_cache(ecu) : NULL;
+	int row = (dat.m_currentFuelMapRowIndex < CUX_FUEL_MAP_ROWS) ? dat.m_currentFuelMapRowIndex : CUX_FUEL_MAP_ROWS - 1;
+	int col = (dat.m_currentFuelMapColumnIndex < CUX_FUEL_MAP_COLUMNS) ? dat.m_currentFuelMapColumnIndex : CUX_FUEL_MAP_COLUMNS - 1;
+	int rowWeight = (row < CUX_FUEL_MAP_ROWS - 1) ? dat.m_fuelMapRowWeighting & 0x0f : 0;
+	int colWeight = (col < CUX_FUEL_MAP_COLUMNS - 1) ? dat.m_fuelMapColWeighting & 0x0f : 0;
+	int marks[4];
+	int count = 0;
+	int32_t sum = 0;
+	char num[NUMLEN];
+	char text[COLS];
+	int i, j;
+
+	if(fuelDrawnMap != dat.m_currentFuelMapIndex) {
+		uint16_t adjustment;
+
+		render_popup_clear();
+		render_popup_text(ROWS - 2, 0, RENDER_REVERSE, "Esc");
+		fuelDrawnMap = -1;
+		fuelMarkCount = 0;
+
+		if(replayLog || remote) {
+			render_popup_text(1, 1, RENDER_NORMAL, "* Fuel maps come from the ECU's ROM, so need a direct connection");
+		}
+		else if(! dat.m_fuelMapIndexRead) {
+			render_popup_text(1, 1, RENDER_NORMAL, "* The active fuel map has not been read yet");
+		}
+		else if(romcache_state(rom) == romstate_failed) {
+			render_popup_text(1, 1, RENDER_NORMAL, "* Fuel map %u is active; the ROM dump never passed its checksum", dat.m_currentFuelMapIndex);
+		}
+		else if(! romcache_fuel_map(rom, dat.m_currentFuelMapIndex, fuelCells, &adjustment)) {
+			render_popup_text(1, 1, RENDER_NORMAL, "* Fuel map %u is active; the ROM has not been read yet", dat.m_currentFuelMapIndex);
+		}
+		else {
+			render_popup_text(1, 1, RENDER_NORMAL, "Fuel map %u (%s loop), adjustment factor %04x", dat.m_currentFuelMapIndex,
+					(feedback_mode_for_map(dat.m_currentFuelMapIndex) == C14CUX_FeedbackMode_OpenLoop) ? "open" : "closed", adjustment);
+
+			for(j = 0; j < CUX_FUEL_MAP_COLUMNS; j++) {
+				render_popup_text(FUEL_TOP - 1, FUEL_LEFT + j * FUEL_CELL, RENDER_NORMAL, "%3d", j);
+			}
+
+			for(i = 0; i < CUX_FUEL_MAP_ROWS; i++) {
+				render_popup_text(FUEL_TOP + i, 1, RENDER_NORMAL, "%2d", i);
+
+				for(j = 0; j < CUX_FUEL_MAP_COLUMNS; j++) {
+					fuel_cell(i * CUX_FUEL_MAP_COLUMNS + j, RENDER_NORMAL);
+				}
+			}
+
+			fuelDrawnMap = dat.m_currentFuelMapIndex;
+		}
+
+		render_popup_show(true);
+
+		// nothing to mark yet; try again next tick
+		if(fuelDrawnMap < 0) {
+			return;
+		}
 	}
 
-	attroff(A_REVERSE);
+	// the cells that carry any weight at the operating point
+	for(i = 0; i < 4; i++) {
+		int cell = (row + (i >> 1)) * CUX_FUEL_MAP_COLUMNS + col + (i & 1);
+		int weight = ((i >> 1) ? rowWeight : 16 - rowWeight) * ((i & 1) ? colWeight : 16 - colWeight);
+
+		if(weight > 0) {
+			marks[count++] = cell;
+			sum += weight * fuelCells[cell];
+		}
+	}
+
+	// unmark what the operating point has left, then mark where it has arrived
+	for(i = 0; i < fuelMarkCount; i++) {
+		for(j = 0; (j < count) && (marks[j] != fuelMarks[i]); j++);
+
+		if(j == count) {
+			fuel_cell(fuelMarks[i], RENDER_NORMAL);
+		}
+	}
+
+	for(i = 0; i < count; i++) {
+		for(j = 0; (j < fuelMarkCount) && (fuelMarks[j] != marks[i]); j++);
+
+		if(j == fuelMarkCount) {
+			fuel_cell(marks[i], RENDER_REVERSE);
+		}
+	}
+
+	memcpy(fuelMarks, marks, sizeof(marks));
+	fuelMarkCount = count;
+
+	snprintf(text, sizeof(text), "Row %d + %d/16, column %d + %d/16, interpolated value %s", row, rowWeight, col, colWeight,
+			format_decimal(num, NUMLEN, (sum * 10 + 128) / 256, 1));
+	render_popup_text(FUEL_TOP + CUX_FUEL_MAP_ROWS, 1, RENDER_NORMAL, "%-*s", COLS - 2, text);
+	snprintf(text, sizeof(text), "Lambda trim: odd %d, even %d", dat.m_lambdaTrimOdd, dat.m_lambdaTrimEven);
+	render_popup_text(FUEL_TOP + CUX_FUEL_MAP_ROWS + 1, 1, RENDER_NORMAL, "%-*s", COLS - 2, text);
+
+	return;
+}
+
+void fuel_cell(int cell, int attr) {
+	render_popup_text(FUEL_TOP + cell / CUX_FUEL_MAP_COLUMNS, FUEL_LEFT + (cell % CUX_FUEL_MAP_COLUMNS) * FUEL_CELL, attr, "%3u", fuelCells[cell]);
+}
+
+void update_data() {
+	int row;
+	char num[NUMLEN];
+	static read_result result = readresult_nostatement;
+	static bool beat;
+	acq_snapshot snap;
+
+	// heartbeat: the bottom-right cell alternates every tick
+	render_field(FIELD_HEARTBEAT, ROWS - 1, COLS - 1, beat ? RENDER_NORMAL : RENDER_REVERSE, " ");
+	beat = ! beat;
+
+	if(replayLog) {
+		read_result replayed = replay_advance(replayLog, &dat, monotonic_us() / 1000);
+
+		if(replayed != readresult_nostatement) {
+			result = replayed;
+			derived_update(uiDerived, replayLog->m_positionMs, &dat);
+			history_add(uiHistory, replayLog->m_positionMs, &dat);
+		}
+
+		derived_summarise(uiDerived, derivedNow);
+	}
+	// the event loop decodes telemetry as it arrives
+	else if(remote) {
+		if(remoteResult != readresult_nostatement) {
+			result = remoteResult;
+			remoteResult = readresult_nostatement;
+		}
+
+		derived_summarise(uiDerived, derivedNow);
+	}
+	// render whatever the acquisition thread last completed; the link may be slower than the screen
+	else if(acquisition_latest(&snap)) {
+		dat = snap.m_data;
+		result = snap.m_result;
+		memcpy(derivedNow, snap.m_derived, sizeof(derivedNow));
+	}
+
+	if(replayLog) {
+		write_replay_status();
+	}
+	else if(remote && ! telem_client_connected(remote)) {
+		render_field(FIELD_STATUS, ROWS - 1, COL2, RENDER_REVERSE, "%s", "No Srv  ");
+	}
+	else if(! remote && (get_link_state(ecu) == linkstate_down)) {
+		render_field(FIELD_STATUS, ROWS - 1, COL2, RENDER_REVERSE, "%s", "Link Dn ");
+	}
+	else if(! remote && (get_link_state(ecu) == linkstate_resync)) {
+		render_field(FIELD_STATUS, ROWS - 1, COL2, RENDER_REVERSE, "%s", "Resync  ");
+	}
+	else {
+		render_field(FIELD_STATUS, ROWS - 1, COL2, RENDER_REVERSE, "%s", (result == readresult_failure) ? "Read Err" : "Read Ok ");
+	}
 
 	row = 1;
-	if(dat.m_milOn) attron(A_REVERSE);
-	mvprintw(row, COL1_D, "%-" STR(FLEN) "s", dat.m_milOn ? "On" : "Off" );
-	attroff(A_REVERSE);
+	render_field(FIELD_MIL, row, COL1_D, dat.m_milOn ? RENDER_REVERSE : RENDER_NORMAL, "%-" STR(FLEN) "s", dat.m_milOn ? "On" : "Off" );
+	update_faults(row);
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) "u", dat.m_engineSpeedRPM);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "d", convertTemperature(dat.m_coolantTempF, Celsius*metric));
+	render_field(FIELD_RPM, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "u", dat.m_engineSpeedRPM);
+	render_field(FIELD_COOLANT_TEMP, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "d", convertTemperature(dat.m_coolantTempF, Celsius*metric));
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) "u", convertSpeed(dat.m_roadSpeedMPH, KPH*metric));
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "d", convertTemperature(dat.m_fuelTempF, Celsius*metric));
+	render_field(FIELD_ROAD_SPEED, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "u", convertSpeed(dat.m_roadSpeedMPH, KPH*metric));
+	render_field(FIELD_FUEL_TEMP, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "d", convertTemperature(dat.m_fuelTempF, Celsius*metric));
 	row++;
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) ".1f", dat.m_mafReading*100);
+	render_field(FIELD_MAF, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(dat.m_mafReading, ECU_FRACTION_ONE, 1000), 1));
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) ".1f", dat.m_throttlePos*100);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "u", dat.m_rpmLimit);
+	render_field(FIELD_THROTTLE, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(dat.m_throttlePos, ECU_FRACTION_ONE, 1000), 1));
+	render_field(FIELD_RPM_LIMIT, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "u", dat.m_rpmLimit);
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) ".1f", dat.m_idleBypassPos*100);
-	if(dat.m_idleMode) attron(A_REVERSE);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "u", dat.m_targetIdleSpeed);
-	attroff(A_REVERSE);
+	render_field(FIELD_IDLE_BYPASS, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(dat.m_idleBypassPos, ECU_FRACTION_ONE, 1000), 1));
+	render_field(FIELD_IDLE_TARGET, row, COL2_D, dat.m_idleMode ? RENDER_REVERSE : RENDER_NORMAL, "%-" STR(FLEN) "u", dat.m_targetIdleSpeed);
 	row++;
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) "d", dat.m_lambdaTrimOdd);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "d", dat.m_lambdaTrimEven);
+	render_field(FIELD_LAMBDA_ODD, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "d", dat.m_lambdaTrimOdd);
+	render_field(FIELD_LAMBDA_EVEN, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "d", dat.m_lambdaTrimEven);
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) ".1f", (dat.m_injectorPulseWidthMs / (60.0 / (float)dat.m_engineSpeedRPM * 1000.0)) * 100);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) ".2f", dat.m_injectorPulseWidthMs);
+	render_field(FIELD_DUTY_CYCLE, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(derivedNow[derived_dutycycle].m_value, DERIVED_ONE, 10), 1));
+	render_field(FIELD_PULSE_WIDTH, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(dat.m_injectorPulseWidthMs, ECU_MS, 100), 2));
 	row++;
+	render_field(FIELD_FUEL_FLOW, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(derivedNow[derived_fuelflow].m_value, DERIVED_ONE, 10), 1));
+	render_field(FIELD_LAMBDA_AVG, row, COL2_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(derivedNow[derived_lambdatrim].m_value, DERIVED_ONE, 10), 1));
 	row++;
-	mvprintw(row, COL1_D, "%-" STR(FLEN) ".2f", dat.m_mainVoltage);	
-	if(dat.m_fuelPumpRelayOn) attron(A_REVERSE);
-	mvprintw(row, COL2_D, "%-" STR(FLEN) "s", dat.m_fuelPumpRelayOn ? "On" : "Off" );
-	attroff(A_REVERSE);
+	render_field(FIELD_MAIN_VOLTAGE, row, COL1_D, RENDER_NORMAL, "%-" STR(FLEN) "s", format_decimal(num, NUMLEN, ecu_scaled(dat.m_mainVoltage, ECU_VOLT, 100), 2));
+	render_field(FIELD_FUEL_PUMP, row, COL2_D, dat.m_fuelPumpRelayOn ? RENDER_REVERSE : RENDER_NORMAL, "%-" STR(FLEN) "s", dat.m_fuelPumpRelayOn ? "On" : "Off" );
+
+	if(graphShown) {
+		graph_window();
+	}
 
-	update_panels();
-	doupdate();
+	if(fuelShown) {
+		fuel_window();
+	}
+
+	render_flush();
 
 	return;
 }
 
-void write_faults() {
+// Active fault count, shown reversed while any of them is new since the codes popup was last opened.
+void update_faults(int row) {
+	uint8_t* seen = (uint8_t*)&faultsSeen;
+	const uint8_t* now = (const uint8_t*)&dat.m_faultCodes;
+	char text[16];
+	int fresh, i;
+
+	if(! dat.m_faultsRead) {
+		render_field(FIELD_FAULTS, row, COL2_D, RENDER_NORMAL, "%-14s", "-");
+		return;
+	}
+
+	// a code that clears and comes back is new again
+	for(i = 0; i < sizeof(faultsSeen); i++) {
+		seen[i] &= now[i];
+	}
+
+	fresh = fault_diff(&faultsSeen, &dat.m_faultCodes, NULL);
+	snprintf(text, sizeof(text), fresh ? "%d, %d new" : "%d", fault_count(&dat.m_faultCodes), fresh);
+	render_field(FIELD_FAULTS, row, COL2_D, fresh ? RENDER_REVERSE : RENDER_NORMAL, "%-14s", text);
+
+}
+
+// Newly set codes are marked with a '+' rather than a '*'.
+void write_faults(const c14cux_faultcodes* fresh) {
 	int i = 1;
 
-	if(dat.m_faultCodes.ROM_Checksum_Failure) mvwprintw(popupw, i++, 1, "* (29) ECU checksum error");
-	if(dat.m_faultCodes.Lambda_Sensor_Odd) mvwprintw(popupw, i++, 1, "* (44) Lambda sensor (odd)");
-	if(dat.m_faultCodes.Lambda_Sensor_Even) mvwprintw(popupw, i++, 1, "* (45) Lambda sensor (even)");
-	if(dat.m_faultCodes.Misfire_Odd_Bank) mvwprintw(popupw, i++, 1, "* (40) Misfire (odd)");
-	if(dat.m_faultCodes.Misfire_Even_Bank) mvwprintw(popupw, i++, 1, "* (50) Misfire (even)");
-	if(dat.m_faultCodes.Airflow_Meter) mvwprintw(popupw, i++, 1, "* (12) Airflow meter");
-	if(dat.m_faultCodes.Tune_Resistor_Out_of_Range) mvwprintw(popupw, i++, 1, "* (21) Tune resistor out of range");
-	if(dat.m_faultCodes.Injector_Odd_Bank) mvwprintw(popupw, i++, 1, "* (34) Injector bank (odd)");
-	if(dat.m_faultCodes.Injector_Even_Bank) mvwprintw(popupw, i++, 1, "* (36) Injector bank (even)");
-	if(dat.m_faultCodes.Coolant_Temp_Sensor) mvwprintw(popupw, i++, 1, "* (14) Coolant temp sensor");
-	if(dat.m_faultCodes.Throttle_Pot) mvwprintw(popupw, i++, 1, "* (17) Throttle pot");
-	if(dat.m_faultCodes.Throttle_Pot_Hi_MAF_Lo) mvwprintw(popupw, i++, 1, "* (18) Throttle pot hi / MAF lo");
-	if(dat.m_faultCodes.Throttle_Pot_Lo_MAF_Hi) mvwprintw(popupw, i++, 1, "* (19) Throttle pot lo / MAF hi");
-	if(dat.m_faultCodes.Purge_Valve_Leak) mvwprintw(popupw, i++, 1, "* (88) Purge valve leak");
-	if(dat.m_faultCodes.Mixture_Too_Lean) mvwprintw(popupw, i++, 1, "* (26) Mixture too lean");
-	if(dat.m_faultCodes.Intake_Air_Leak) mvwprintw(popupw, i++, 1, "* (28) Intake air leak");
-	if(dat.m_faultCodes.Low_Fuel_Pressure) mvwprintw(popupw, i++, 1, "* (23) Low fuel pressure");
-	if(dat.m_faultCodes.Idle_Valve_Stepper_Motor) mvwprintw(popupw, i++, 1, "* (48) Idle Air Control stepper motor");
-	if(dat.m_faultCodes.Road_Speed_Sensor) mvwprintw(popupw, i++, 1, "* (68) Road speed sensor");
-	if(dat.m_faultCodes.Neutral_Switch) mvwprintw(popupw, i++, 1, "* (69) Neutral (gear selector) switch");
-	if(dat.m_faultCodes.Low_Fuel_Pressure_or_Air_Leak) mvwprintw(popupw, i++, 1, "* (58) Ambiguous: low fuel pressure or air leak");
-	if(dat.m_faultCodes.Fuel_Temp_Sensor) mvwprintw(popupw, i++, 1, "* (15) Fuel temp sensor");
-	if(dat.m_faultCodes.Battery_Disconnected) mvwprintw(popupw, i++, 1, "* (02) RAM contents unreliable (battery disconnected)");
-	if(dat.m_faultCodes.RAM_Checksum_Failure) mvwprintw(popupw, i++, 1, "* (03) Bad checksum on battery-backed RAM");
+	fault_line(&i, dat.m_faultCodes.ROM_Checksum_Failure, fresh->ROM_Checksum_Failure, "(29) ECU checksum error");
+	fault_line(&i, dat.m_faultCodes.Lambda_Sensor_Odd, fresh->Lambda_Sensor_Odd, "(44) Lambda sensor (odd)");
+	fault_line(&i, dat.m_faultCodes.Lambda_Sensor_Even, fresh->Lambda_Sensor_Even, "(45) Lambda sensor (even)");
+	fault_line(&i, dat.m_faultCodes.Misfire_Odd_Bank, fresh->Misfire_Odd_Bank, "(40) Misfire (odd)");
+	fault_line(&i, dat.m_faultCodes.Misfire_Even_Bank, fresh->Misfire_Even_Bank, "(50) Misfire (even)");
+	fault_line(&i, dat.m_faultCodes.Airflow_Meter, fresh->Airflow_Meter, "(12) Airflow meter");
+	fault_line(&i, dat.m_faultCodes.Tune_Resistor_Out_of_Range, fresh->Tune_Resistor_Out_of_Range, "(21) Tune resistor out of range");
+	fault_line(&i, dat.m_faultCodes.Injector_Odd_Bank, fresh->Injector_Odd_Bank, "(34) Injector bank (odd)");
+	fault_line(&i, dat.m_faultCodes.Injector_Even_Bank, fresh->Injector_Even_Bank, "(36) Injector bank (even)");
+	fault_line(&i, dat.m_faultCodes.Coolant_Temp_Sensor, fresh->Coolant_Temp_Sensor, "(14) Coolant temp sensor");
+	fault_line(&i, dat.m_faultCodes.Throttle_Pot, fresh->Throttle_Pot, "(17) Throttle pot");
+	fault_line(&i, dat.m_faultCodes.Throttle_Pot_Hi_MAF_Lo, fresh->Throttle_Pot_Hi_MAF_Lo, "(18) Throttle pot hi / MAF lo");
+	fault_line(&i, dat.m_faultCodes.Throttle_Pot_Lo_MAF_Hi, fresh->Throttle_Pot_Lo_MAF_Hi, "(19) Throttle pot lo / MAF hi");
+	fault_line(&i, dat.m_faultCodes.Purge_Valve_Leak, fresh->Purge_Valve_Leak, "(88) Purge valve leak");
+	fault_line(&i, dat.m_faultCodes.Mixture_Too_Lean, fresh->Mixture_Too_Lean, "(26) Mixture too lean");
+	fault_line(&i, dat.m_faultCodes.Intake_Air_Leak, fresh->Intake_Air_Leak, "(28) Intake air leak");
+	fault_line(&i, dat.m_faultCodes.Low_Fuel_Pressure, fresh->Low_Fuel_Pressure, "(23) Low fuel pressure");
+	fault_line(&i, dat.m_faultCodes.Idle_Valve_Stepper_Motor, fresh->Idle_Valve_Stepper_Motor, "(48) Idle Air Control stepper motor");
+	fault_line(&i, dat.m_faultCodes.Road_Speed_Sensor, fresh->Road_Speed_Sensor, "(68) Road speed sensor");
+	fault_line(&i, dat.m_faultCodes.Neutral_Switch, fresh->Neutral_Switch, "(69) Neutral (gear selector) switch");
+	fault_line(&i, dat.m_faultCodes.Low_Fuel_Pressure_or_Air_Leak, fresh->Low_Fuel_Pressure_or_Air_Leak, "(58) Ambiguous: low fuel pressure or air leak");
+	fault_line(&i, dat.m_faultCodes.Fuel_Temp_Sensor, fresh->Fuel_Temp_Sensor, "(15) Fuel temp sensor");
+	fault_line(&i, dat.m_faultCodes.Battery_Disconnected, fresh->Battery_Disconnected, "(02) RAM contents unreliable (battery disconnected)");
+	fault_line(&i, dat.m_faultCodes.RAM_Checksum_Failure, fresh->RAM_Checksum_Failure, "(03) Bad checksum on battery-backed RAM");
 
 	return;
 }
 
 
-void setup_aio_buffer(struct aiocb *aio_buf) {
-	static char input[1];
-
-	aio_buf->aio_fildes = 0;
-	aio_buf->aio_buf = input;
-	aio_buf->aio_nbytes = 1;
-	aio_buf->aio_offset = 0;
+void fault_line(int* row, bool set, bool fresh, const char* text) {
 
-	aio_buf->aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-	aio_buf->aio_sigevent.sigev_signo = SIGIO;
+	if(set) {
+		render_popup_text((*row)++, 1, RENDER_NORMAL, "%c %s", fresh ? '+' : '*', text);
+	}
 
-	return;
 }
 
-void process_key() {
-	char *cp = (char *) kbcbuf.aio_buf;
+void process_key(char c) {
 
-	if(aio_error(&kbcbuf) != 0) {
-		perror("AIO read failed.");
+	if(replayLog && strchr(" +=-,.<>", c)) {
+		replay_key(c);
 	}
 	else {
-		switch(*cp) {
+		switch(c) {
 			case 'U':
 			case 'u':
 				metric = !metric;
@@ -421,22 +1074,334 @@ void process_key() {
 				break;
 			case 'C':
 			case 'c':
+				graphShown = false;
+				fuelShown = false;
 				codes_window();
 				break;
 			case 'I':
 			case 'i':
+				graphShown = false;
+				fuelShown = false;
 				info_window();
 				break;
+			case 'S':
+			case 's':
+				graphShown = false;
+				fuelShown = false;
+				stats_window();
+				break;
+			case 'D':
+			case 'd':
+				graphShown = false;
+				fuelShown = false;
+				derived_window();
+				break;
+			case 'F':
+			case 'f':
+				graphShown = false;
+				fuelShown = true;
+				fuelDrawnMap = -1;
+				fuel_window();
+				render_flush();
+				break;
+			case 'P':
+			case 'p':
+				if(replayLog || remote) {
+					derived_reset_peaks(uiDerived);
+				}
+				else {
+					acquisition_reset_peaks();
+				}
+				break;
+			case 'L':
+			case 'l':
+				if(! replayLog && ! remote) {
+					toggle_log();
+					do_layout();
+				}
+				break;
+			case 'G':
+			case 'g':
+				// the first press opens the page, the next ones step through the channels
+				if(graphShown) {
+					do {
+						graphType = (graphType + 1) % SampleType_NumSampleTypes;
+					} while(sample_value_count(graphType) == 0);
+				}
+
+				graphShown = true;
+				fuelShown = false;
+				graph_window();
+				render_flush();
+				break;
+			case 'T':
+			case 't':
+				if(graphShown) {
+					graphSpan = (graphSpan + 1) % (sizeof(graphSpansMs) / sizeof(graphSpansMs[0]));
+					graph_window();
+					render_flush();
+				}
+				break;
 			case 27:
-				hide_panel(popupp);
-				update_panels();
-				doupdate();
+				graphShown = false;
+				fuelShown = false;
+				render_popup_show(false);
+				render_flush();
 				break;
 		}
 	}
 
-	aio_read(&kbcbuf);
+	return;
+}
+
+
+void toggle_log() {
+	session_log* log;
+
+	if(logging) {
+		log = acquisition_set_log(NULL);
+		sessionlog_close(log);
+		logging = false;
+	}
+	else {
+		char name[64];
+		time_t now = time(NULL);
+
+		strftime(name, sizeof(name), "roverdisplay-%Y%m%d-%H%M%S.rdl", localtime(&now));
+		log = sessionlog_open(name, wallclock_ms());
+
+		if(log) {
+			acquisition_set_log(log);
+			logging = true;
+		}
+	}
+
+	return;
+}
+
+void replay_key(char c) {
+	uint64_t now = monotonic_us() / 1000;
+	int64_t step = 0;
+
+	switch(c) {
+		case ' ':
+			replay_set_paused(replayLog, ! replayLog->m_paused, now);
+			break;
+		case '+':
+		case '=':
+			replay_set_speed(replayLog, replayLog->m_speed * 2, now);
+			break;
+		case '-':
+			replay_set_speed(replayLog, replayLog->m_speed / 2, now);
+			break;
+		case ',':
+			step = -10000;
+			break;
+		case '.':
+			step = 10000;
+			break;
+		case '<':
+			step = -60000;
+			break;
+		case '>':
+			step = 60000;
+			break;
+	}
+
+	if(step != 0) {
+		int64_t target = (int64_t)replayLog->m_positionMs + step;
+
+		replay_seek(replayLog, &dat, target < 0 ? 0 : target, now);
+
+		// history only runs forwards
+		if(step < 0) {
+			history_init(uiHistory, replayLog->m_firstMs);
+		}
+	}
 
 	return;
 }
 
+void write_replay_status() {
+	unsigned int pos = (replayLog->m_positionMs - replayLog->m_firstMs) / 1000;
+	unsigned int len = (replayLog->m_lastMs - replayLog->m_firstMs) / 1000;
+	char speed[12];
+
+	if(replayLog->m_paused) {
+		snprintf(speed, sizeof(speed), "Paused");
+	}
+	else if(replayLog->m_speed < REPLAY_SPEED_NORMAL) {
+		snprintf(speed, sizeof(speed), "%.2fx", (float)replayLog->m_speed / REPLAY_SPEED_NORMAL);
+	}
+	else {
+		snprintf(speed, sizeof(speed), "%ux", replayLog->m_speed / REPLAY_SPEED_NORMAL);
+	}
+
+	render_field(FIELD_STATUS, ROWS - 1, COL2, RENDER_REVERSE, "%02u:%02u:%02u/%02u:%02u:%02u %-6s", pos / 3600, (pos / 60) % 60, pos % 60, len / 3600, (len / 60) % 60, len % 60, speed);
+
+	return;
+}
+
+// Daemon mode: own the ECU and stream every pass to telemetry subscribers until interrupted.
+int serve(const char* addr, const char* port, unsigned int options, const char* shmName) {
+	struct sigaction handler;
+	telem_server* server;
+	shm_table* table = NULL;
+
+	ecu = connect_to_ecu(&dat, port, options);
+
+	if(! ecu) {
+		fprintf(stderr, "Could not open serial port.\n");
+		return 1;
+	}
+
+	server = telem_server_open(addr);
+
+	if(! server) {
+		fprintf(stderr, "Could not listen on %s.\n", addr);
+		disconnect_from_ecu(ecu);
+		return 1;
+	}
+
+	if(shmName && ! (table = shmtable_create(shmName))) {
+		fprintf(stderr, "Could not create shared memory table %s.\n", shmName);
+		telem_server_close(server);
+		disconnect_from_ecu(ecu);
+		return 1;
+	}
+
+	memset(&handler, 0, sizeof(handler));
+	handler.sa_handler = exit_handler;
+	sigaction(SIGINT, &handler, NULL);
+	sigaction(SIGTERM, &handler, NULL);
+
+	run = 1;
+
+	while(run) {
+		read_result result = read_data(ecu, &dat);
+
+		if(result == readresult_nostatement) {
+			telem_server_service(server, ACQ_IDLE_US / 1000);
+		}
+		else {
+			uint64_t now = wallclock_ms();
+
+			if(table) {
+				shmtable_publish(table, now, &dat);
+			}
+
+			telem_server_publish(server, now, &dat, result);
+			telem_server_service(server, 0);
+		}
+	}
+
+	print_poll_stats(ecu, stdout);
+	print_latency(ecu, stdout);
+	print_telem_stats(server, stdout);
+	telem_server_close(server);
+
+	if(table) {
+		shmtable_close(table);
+	}
+
+	disconnect_from_ecu(ecu);
+
+	return 0;
+}
+
+// Replay and telemetry keep their own derived channels and history; live mode leaves both to the acquisition thread.
+bool ui_state_init(uint32_t windowMs, uint64_t startMs) {
+	uiDerived = malloc(sizeof(derived_state));
+	uiHistory = malloc(sizeof(history));
+
+	if(! uiDerived || ! uiHistory) {
+		return false;
+	}
+
+	derived_init(uiDerived, windowMs, startMs);
+	history_init(uiHistory, startMs);
+
+	return true;
+}
+
+// Headless mode: no screen, every pass goes to stdout; statistics go to stderr.
+int headless(const char* port, stream_format format, unsigned int options, const char* shmName) {
+	struct sigaction handler;
+	sample_stream* out;
+	shm_table* table = NULL;
+	bool written;
+
+	ecu = connect_to_ecu(&dat, port, options);
+
+	if(! ecu) {
+		fprintf(stderr, "Could not open serial port.\n");
+		return 1;
+	}
+
+	if(shmName && ! (table = shmtable_create(shmName))) {
+		fprintf(stderr, "Could not create shared memory table %s.\n", shmName);
+		disconnect_from_ecu(ecu);
+		return 1;
+	}
+
+	out = stream_open(STDOUT_FILENO, format, wallclock_ms());
+
+	if(! out) {
+		fprintf(stderr, "Could not start the output stream.\n");
+
+		if(table) {
+			shmtable_close(table);
+		}
+
+		disconnect_from_ecu(ecu);
+		return 1;
+	}
+
+	memset(&handler, 0, sizeof(handler));
+	handler.sa_handler = exit_handler;
+	sigaction(SIGINT, &handler, NULL);
+	sigaction(SIGTERM, &handler, NULL);
+	// a closed pipe shows up as a write error instead
+	signal(SIGPIPE, SIG_IGN);
+
+	run = 1;
+
+	while(run) {
+		read_result result = read_data(ecu, &dat);
+		uint64_t now;
+
+		if(result == readresult_nostatement) {
+			usleep(ACQ_IDLE_US);
+			continue;
+		}
+
+		now = wallclock_ms();
+
+		if(table) {
+			shmtable_publish(table, now, &dat);
+		}
+
+		if(! stream_write(out, now, &dat)) {
+			break;
+		}
+	}
+
+	fprintf(stderr, "%llu records streamed\n", (unsigned long long)out->m_records);
+
+	// a reader that went away, or a full disk, must show in the exit status
+	written = stream_close(out);
+
+	if(! written) {
+		fprintf(stderr, "Output stream ended with a write error.\n");
+	}
+
+	if(table) {
+		shmtable_close(table);
+	}
+
+	print_poll_stats(ecu, stderr);
+	print_latency(ecu, stderr);
+	disconnect_from_ecu(ecu);
+
+	return written ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+#include "samples.h"
+
+static const uint8_t valueCounts[SampleType_NumSampleTypes] = {
+	[SampleType_EngineTemperature]  = 1,
+	[SampleType_RoadSpeed]          = 1,
+	[SampleType_EngineRPM]          = 2,
+	[SampleType_FuelTemperature]    = 1,
+	[SampleType_MAF]                = 1,
+	[SampleType_Throttle]           = 1,
+	[SampleType_IdleBypassPosition] = 1,
+	[SampleType_TargetIdleRPM]      = 2,
+	[SampleType_GearSelection]      = 1,
+	[SampleType_MainVoltage]        = 1,
+	[SampleType_LambdaTrimShort]    = 2,
+	[SampleType_LambdaTrimLong]     = 2,
+	[SampleType_COTrimVoltage]      = 1,
+	[SampleType_FuelPumpRelay]      = 1,
+	[SampleType_FuelMapRowCol]      = 2,
+	[SampleType_FuelMapData]        = 0,
+	[SampleType_FuelMapIndex]       = 1,
+	[SampleType_InjectorPulseWidth] = 1,
+	[SampleType_MIL]                = 1
+	};
+
+// Column names for each value slot, for text output.
+static const char* const valueNames[SampleType_NumSampleTypes][SAMPLE_MAX_VALUES] = {
+	[SampleType_EngineTemperature]  = { "coolant_temp_f" },
+	[SampleType_RoadSpeed]          = { "road_speed_mph" },
+	[SampleType_EngineRPM]          = { "engine_rpm", "rpm_limit" },
+	[SampleType_FuelTemperature]    = { "fuel_temp_f" },
+	[SampleType_MAF]                = { "maf" },
+	[SampleType_Throttle]           = { "throttle" },
+	[SampleType_IdleBypassPosition] = { "idle_bypass" },
+	[SampleType_TargetIdleRPM]      = { "target_idle_rpm", "idle_mode" },
+	[SampleType_GearSelection]      = { "gear" },
+	[SampleType_MainVoltage]        = { "main_voltage" },
+	[SampleType_LambdaTrimShort]    = { "lambda_short_odd", "lambda_short_even" },
+	[SampleType_LambdaTrimLong]     = { "lambda_long_odd", "lambda_long_even" },
+	[SampleType_COTrimVoltage]      = { "co_trim_voltage" },
+	[SampleType_FuelPumpRelay]      = { "fuel_pump" },
+	[SampleType_FuelMapRowCol]      = { "fuel_map_row", "fuel_map_col" },
+	[SampleType_FuelMapIndex]       = { "fuel_map_index" },
+	[SampleType_InjectorPulseWidth] = { "pulse_width_us" },
+	[SampleType_MIL]                = { "mil" }
+	};
+
+int sample_value_count(SampleType type) {
+	return valueCounts[type];
+}
+
+const char* sample_value_name(SampleType type, int slot) {
+	return valueNames[type][slot];
+}
+
+// What the encoded integer has to be divided by to get back to ecu_data's units.
+int32_t sample_value_scale(SampleType type, int slot) {
+
+	switch(type) {
+		case SampleType_MAF:
+		case SampleType_Throttle:
+		case SampleType_IdleBypassPosition:
+			return SAMPLE_FRACTION_SCALE;
+		case SampleType_MainVoltage:
+		case SampleType_COTrimVoltage:
+			return 1000;
+		default:
+			return 1;
+	}
+
+}
+
+int sample_encode(const ecu_data* dat, SampleType type, int32_t* values) {
+
+	switch(type) {
+		case SampleType_EngineTemperature:
+			values[0] = dat->m_coolantTempF;
+			break;
+		case SampleType_RoadSpeed:
+			values[0] = dat->m_roadSpeedMPH;
+			break;
+		case SampleType_EngineRPM:
+			values[0] = dat->m_engineSpeedRPM;
+			values[1] = dat->m_rpmLimit;
+			break;
+		case SampleType_FuelTemperature:
+			values[0] = dat->m_fuelTempF;
+			break;
+		case SampleType_MAF:
+			values[0] = ecu_scaled(dat->m_mafReading, ECU_FRACTION_ONE, SAMPLE_FRACTION_SCALE);
+			break;
+		case SampleType_Throttle:
+			values[0] = ecu_scaled(dat->m_throttlePos, ECU_FRACTION_ONE, SAMPLE_FRACTION_SCALE);
+			break;
+		case SampleType_IdleBypassPosition:
+			values[0] = ecu_scaled(dat->m_idleBypassPos, ECU_FRACTION_ONE, SAMPLE_FRACTION_SCALE);
+			break;
+		case SampleType_TargetIdleRPM:
+			values[0] = dat->m_targetIdleSpeed;
+			values[1] = dat->m_idleMode;
+			break;
+		case SampleType_GearSelection:
+			values[0] = dat->m_gear;
+			break;
+		case SampleType_MainVoltage:
+			values[0] = ecu_scaled(dat->m_mainVoltage, ECU_VOLT, 1000);
+			break;
+		case SampleType_LambdaTrimShort:
+		case SampleType_LambdaTrimLong:
+			values[0] = dat->m_lambdaTrimOdd;
+			values[1] = dat->m_lambdaTrimEven;
+			break;
+		case SampleType_COTrimVoltage:
+			values[0] = ecu_scaled(dat->m_coTrimVoltage, ECU_VOLT, 1000);
+			break;
+		case SampleType_FuelPumpRelay:
+			values[0] = dat->m_fuelPumpRelayOn;
+			break;
+		case SampleType_FuelMapRowCol:
+			values[0] = (dat->m_currentFuelMapRowIndex << 8) | dat->m_fuelMapRowWeighting;
+			values[1] = (dat->m_currentFuelMapColumnIndex << 8) | dat->m_fuelMapColWeighting;
+			break;
+		case SampleType_FuelMapIndex:
+			values[0] = dat->m_currentFuelMapIndex;
+			break;
+		case SampleType_InjectorPulseWidth:
+			values[0] = dat->m_injectorPulseWidthUs;
+			break;
+		case SampleType_MIL:
+			values[0] = dat->m_milOn;
+			break;
+		default:
+			break;
+	}
+
+	return valueCounts[type];
+}
+
+void sample_decode(ecu_data* dat, SampleType type, const int32_t* values) {
+
+	switch(type) {
+		case SampleType_EngineTemperature:
+			dat->m_coolantTempF = values[0];
+			break;
+		case SampleType_RoadSpeed:
+			dat->m_roadSpeedMPH = values[0];
+			break;
+		case SampleType_EngineRPM:
+			dat->m_engineSpeedRPM = values[0];
+			dat->m_rpmLimit = values[1];
+			dat->m_rpmLimitRead = (values[1] != 0);
+			break;
+		case SampleType_FuelTemperature:
+			dat->m_fuelTempF = values[0];
+			break;
+		case SampleType_MAF:
+			dat->m_mafReading = ECU_REAL(values[0], SAMPLE_FRACTION_SCALE, ECU_FRACTION_ONE);
+			break;
+		case SampleType_Throttle:
+			dat->m_throttlePos = ECU_REAL(values[0], SAMPLE_FRACTION_SCALE, ECU_FRACTION_ONE);
+			break;
+		case SampleType_IdleBypassPosition:
+			dat->m_idleBypassPos = ECU_REAL(values[0], SAMPLE_FRACTION_SCALE, ECU_FRACTION_ONE);
+			break;
+		case SampleType_TargetIdleRPM:
+			dat->m_targetIdleSpeed = values[0];
+			dat->m_idleMode = values[1];
+			break;
+		case SampleType_GearSelection:
+			dat->m_gear = values[0];
+			break;
+		case SampleType_MainVoltage:
+			dat->m_mainVoltage = ECU_REAL(values[0], 1000, ECU_VOLT);
+			break;
+		case SampleType_LambdaTrimShort:
+		case SampleType_LambdaTrimLong:
+			dat->m_lambdaTrimOdd = values[0];
+			dat->m_lambdaTrimEven = values[1];
+			break;
+		case SampleType_COTrimVoltage:
+			dat->m_coTrimVoltage = ECU_REAL(values[0], 1000, ECU_VOLT);
+			break;
+		case SampleType_FuelPumpRelay:
+			dat->m_fuelPumpRelayOn = values[0];
+			break;
+		case SampleType_FuelMapRowCol:
+			dat->m_currentFuelMapRowIndex = values[0] >> 8;
+			dat->m_fuelMapRowWeighting = values[0] & 0xff;
+			dat->m_currentFuelMapColumnIndex = values[1] >> 8;
+			dat->m_fuelMapColWeighting = values[1] & 0xff;
+			break;
+		case SampleType_FuelMapIndex:
+			dat->m_currentFuelMapIndex = values[0];
+			dat->m_fuelMapIndexRead = true;
+			break;
+		case SampleType_InjectorPulseWidth:
+			dat->m_injectorPulseWidthUs = values[0];
+			dat->m_injectorPulseWidthMs = ECU_REAL(values[0], 1000, ECU_MS);
+			break;
+		case SampleType_MIL:
+			dat->m_milOn = values[0];
+			break;
+		default:
+			break;
+	}
+
+}
+
+uint32_t sample_put_varint(uint8_t* buf, uint32_t value) {
+	uint32_t n = 0;
+
+	while(value >= 0x80) {
+		buf[n++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+
+	buf[n++] = value;
+
+	return n;
+}
+
+// NULL if the varint runs past end or is longer than five bytes.
+const uint8_t* sample_get_varint(const uint8_t* p, const uint8_t* end, uint32_t* value) {
+	uint32_t v = 0;
+	int shift = 0;
+
+	while(p < end) {
+		uint8_t byte = *p++;
+
+		v |= (uint32_t)(byte & 0x7f) << shift;
+
+		if(! (byte & 0x80)) {
+			*value = v;
+			return p;
+		}
+
+		shift += 7;
+
+		if(shift > 28) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t sample_zigzag(int32_t value) {
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t sample_unzigzag(uint32_t value) {
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
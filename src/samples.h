@@ -0,0 +1,30 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include "cuxinterface.h"
+
+/*
+ * Every SampleType maps to one or two integers so that logs, streams and
+ * replay all carry exactly what read_data() stored. Fractions (MAF,
+ * throttle, idle bypass) are scaled by SAMPLE_FRACTION_SCALE and voltages
+ * are in millivolts.
+ */
+
+#define SAMPLE_MAX_VALUES	2
+#define SAMPLE_FRACTION_SCALE	10000
+// Longest encoding of a 32 bit varint.
+#define SAMPLE_VARINT_MAX	5
+
+extern int sample_value_count(SampleType type);
+extern const char* sample_value_name(SampleType type, int slot);
+extern int32_t sample_value_scale(SampleType type, int slot);
+extern int sample_encode(const ecu_data* dat, SampleType type, int32_t* values);
+extern void sample_decode(ecu_data* dat, SampleType type, const int32_t* values);
+
+// Varint and zigzag coding shared by session logs and telemetry frames.
+extern uint32_t sample_put_varint(uint8_t* buf, uint32_t value);
+extern const uint8_t* sample_get_varint(const uint8_t* p, const uint8_t* end, uint32_t* value);
+extern uint32_t sample_zigzag(int32_t value);
+extern int32_t sample_unzigzag(uint32_t value);
+
+#endif
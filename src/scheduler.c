@@ -0,0 +1,272 @@
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "scheduler.h"
+
+/*
+ * Earliest-deadline-first poll scheduler. Each channel sits in a binary
+ * min-heap keyed on its next due time; every tick pops due channels until
+ * the serial time budget for the tick is used up. Channels read during a
+ * tick are held back and only re-enter the heap at the end of it, so a
+ * zero-interval channel is read at most once per tick and slow channels
+ * that are overdue always sort ahead of it.
+ */
+
+static bool heap_less(const poll_scheduler* s, uint8_t a, uint8_t b);
+static void heap_push(poll_scheduler* s, uint8_t id);
+static uint8_t heap_pop(poll_scheduler* s);
+static void defer(poll_scheduler* s, int id);
+static void rebuild(poll_scheduler* s);
+
+uint64_t monotonic_us() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+uint64_t wallclock_ms() {
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_usec / 1000;
+}
+
+void sched_init(poll_scheduler* s, uint32_t tickMs) {
+
+	memset(s, 0, sizeof(*s));
+
+	s->m_tickMs = tickMs;
+	// leave some of each tick for the UI and for transactions that overrun their estimate
+	s->m_budgetUs = tickMs * 800;
+
+}
+
+void sched_add(poll_scheduler* s, int id, uint32_t intervalMs, uint32_t costUs, uint64_t nowMs) {
+	poll_channel* ch = &s->m_channels[id];
+
+	memset(ch, 0, sizeof(*ch));
+
+	ch->m_registered = true;
+	ch->m_priority = s->m_heapSize + s->m_deferredCount;
+	ch->m_intervalMs = intervalMs;
+	ch->m_costUs = costUs;
+	ch->m_dueMs = nowMs;
+
+	heap_push(s, id);
+
+}
+
+void sched_begin_tick(poll_scheduler* s) {
+
+	s->m_spentUs = 0;
+	s->m_ticks++;
+
+}
+
+int sched_next(poll_scheduler* s, uint64_t nowMs) {
+
+	if(s->m_heapSize == 0) {
+		return -1;
+	}
+
+	poll_channel* ch = &s->m_channels[s->m_heap[0]];
+
+	if(ch->m_dueMs > nowMs) {
+		return -1;
+	}
+
+	// always allow one transaction per tick so an over-budget channel cannot starve
+	if((s->m_spentUs > 0) && (s->m_spentUs + ch->m_costUs > s->m_budgetUs)) {
+		return -1;
+	}
+
+	return heap_pop(s);
+}
+
+void sched_done(poll_scheduler* s, int id, uint64_t nowMs, uint32_t tookUs) {
+	poll_channel* ch = &s->m_channels[id];
+	uint32_t lateness = (uint32_t)(nowMs - ch->m_dueMs);
+	uint32_t period = (ch->m_intervalMs > s->m_tickMs) ? ch->m_intervalMs : s->m_tickMs;
+
+	// channels faster than the tick become due at the tick that read them, so one tick of waiting is expected
+	if((ch->m_intervalMs < s->m_tickMs) && (ch->m_reads > 0)) {
+		lateness = (lateness > s->m_tickMs) ? lateness - s->m_tickMs : 0;
+	}
+
+	if(ch->m_reads == 0) {
+		ch->m_firstReadMs = nowMs;
+	}
+
+	ch->m_reads++;
+	ch->m_lastReadMs = nowMs;
+
+	// a whole period went by without this channel being serviced
+	if(lateness >= period) {
+		ch->m_misses++;
+	}
+
+	if(lateness > ch->m_maxLatenessMs) {
+		ch->m_maxLatenessMs = lateness;
+	}
+
+	// track what the link actually delivers rather than the nominal byte count
+	ch->m_costUs = (3 * ch->m_costUs + tookUs) / 4;
+	s->m_spentUs += tookUs;
+
+	ch->m_dueMs += ch->m_intervalMs;
+	if(ch->m_dueMs < nowMs) {
+		ch->m_dueMs = nowMs;
+	}
+
+	defer(s, id);
+
+}
+
+// Only for a channel returned by sched_next() and not yet done; it is outside the heap until then.
+void sched_set_interval(poll_scheduler* s, int id, uint32_t intervalMs) {
+	s->m_channels[id].m_intervalMs = intervalMs;
+}
+
+// Between ticks only. A disabled channel is never returned; enabling it again makes it due at once.
+void sched_set_enabled(poll_scheduler* s, int id, bool enabled, uint64_t nowMs) {
+	poll_channel* ch = &s->m_channels[id];
+
+	if(ch->m_disabled == ! enabled) {
+		return;
+	}
+
+	ch->m_disabled = ! enabled;
+
+	if(enabled) {
+		ch->m_dueMs = nowMs;
+	}
+
+	rebuild(s);
+
+}
+
+void sched_end_tick(poll_scheduler* s) {
+	int i;
+
+	for(i = 0; i < s->m_deferredCount; i++) {
+		heap_push(s, s->m_deferred[i]);
+	}
+
+	s->m_deferredCount = 0;
+
+	if(s->m_spentUs > s->m_tickMs * 1000) {
+		s->m_overruns++;
+	}
+
+}
+
+// Every channel due now, as after a reconnect; between ticks only. Time spent waiting does not count as missed.
+void sched_restart(poll_scheduler* s, uint64_t nowMs) {
+	int id;
+
+	for(id = 0; id < SCHED_MAX_CHANNELS; id++) {
+		s->m_channels[id].m_dueMs = nowMs;
+	}
+
+	rebuild(s);
+
+}
+
+void sched_get_stats(const poll_scheduler* s, int id, uint64_t nowMs, poll_stats* stats) {
+	const poll_channel* ch = &s->m_channels[id];
+
+	stats->m_intervalMs = ch->m_intervalMs;
+	stats->m_costUs = ch->m_costUs;
+	stats->m_reads = ch->m_reads;
+	stats->m_misses = ch->m_misses;
+	stats->m_maxLatenessMs = ch->m_maxLatenessMs;
+	stats->m_rateHz = 0.0;
+
+	if((ch->m_reads > 1) && (ch->m_lastReadMs > ch->m_firstReadMs)) {
+		stats->m_rateHz = (float)(ch->m_reads - 1) * 1000.0 / (float)(ch->m_lastReadMs - ch->m_firstReadMs);
+	}
+
+}
+
+static bool heap_less(const poll_scheduler* s, uint8_t a, uint8_t b) {
+	const poll_channel* ca = &s->m_channels[a];
+	const poll_channel* cb = &s->m_channels[b];
+
+	if(ca->m_dueMs != cb->m_dueMs) {
+		return ca->m_dueMs < cb->m_dueMs;
+	}
+
+	return ca->m_priority < cb->m_priority;
+}
+
+static void heap_push(poll_scheduler* s, uint8_t id) {
+	int i = s->m_heapSize++;
+
+	while(i > 0) {
+		int parent = (i - 1) / 2;
+
+		if(! heap_less(s, id, s->m_heap[parent])) {
+			break;
+		}
+
+		s->m_heap[i] = s->m_heap[parent];
+		i = parent;
+	}
+
+	s->m_heap[i] = id;
+
+}
+
+static uint8_t heap_pop(poll_scheduler* s) {
+	uint8_t top = s->m_heap[0];
+	uint8_t last = s->m_heap[--s->m_heapSize];
+	int i = 0;
+
+	while(true) {
+		int child = 2 * i + 1;
+
+		if(child >= s->m_heapSize) {
+			break;
+		}
+
+		if((child + 1 < s->m_heapSize) && heap_less(s, s->m_heap[child + 1], s->m_heap[child])) {
+			child++;
+		}
+
+		if(! heap_less(s, s->m_heap[child], last)) {
+			break;
+		}
+
+		s->m_heap[i] = s->m_heap[child];
+		i = child;
+	}
+
+	if(s->m_heapSize > 0) {
+		s->m_heap[i] = last;
+	}
+
+	return top;
+}
+
+static void defer(poll_scheduler* s, int id) {
+
+	s->m_deferred[s->m_deferredCount++] = id;
+
+}
+
+// The heap afresh from every enabled channel.
+static void rebuild(poll_scheduler* s) {
+	int id;
+
+	s->m_heapSize = 0;
+
+	for(id = 0; id < SCHED_MAX_CHANNELS; id++) {
+		if(s->m_channels[id].m_registered && ! s->m_channels[id].m_disabled) {
+			heap_push(s, id);
+		}
+	}
+
+}
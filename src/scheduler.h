@@ -0,0 +1,64 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "commonunits.h"
+
+// One byte on the wire at 7812 baud, 8N1 (10 bits).
+#define SCHED_BYTE_US		1280
+// Coarse and fine address bytes (each echoed) plus the length byte.
+#define SCHED_CMD_BYTES		5
+#define SCHED_MAX_CHANNELS	SampleType_NumSampleTypes
+
+typedef struct poll_channel {
+	bool m_registered;
+	bool m_disabled;	// registered but left out of the heap
+	uint8_t m_priority;
+	uint32_t m_intervalMs;
+	uint32_t m_costUs;
+	uint64_t m_dueMs;
+	uint64_t m_firstReadMs;
+	uint64_t m_lastReadMs;
+	uint32_t m_reads;
+	uint32_t m_misses;
+	uint32_t m_maxLatenessMs;
+	} poll_channel;
+
+typedef struct poll_scheduler {
+	poll_channel m_channels[SCHED_MAX_CHANNELS];
+	uint8_t m_heap[SCHED_MAX_CHANNELS];
+	uint8_t m_heapSize;
+	uint8_t m_deferred[SCHED_MAX_CHANNELS];
+	uint8_t m_deferredCount;
+	uint32_t m_tickMs;
+	uint32_t m_budgetUs;
+	uint32_t m_spentUs;
+	uint32_t m_ticks;
+	uint32_t m_overruns;
+	} poll_scheduler;
+
+typedef struct poll_stats {
+	uint32_t m_intervalMs;
+	uint32_t m_costUs;
+	uint32_t m_reads;
+	uint32_t m_misses;
+	uint32_t m_maxLatenessMs;
+	float m_rateHz;
+	} poll_stats;
+
+extern uint64_t monotonic_us();
+extern uint64_t wallclock_ms();
+
+extern void sched_init(poll_scheduler* s, uint32_t tickMs);
+extern void sched_add(poll_scheduler* s, int id, uint32_t intervalMs, uint32_t costUs, uint64_t nowMs);
+extern void sched_begin_tick(poll_scheduler* s);
+extern int sched_next(poll_scheduler* s, uint64_t nowMs);
+extern void sched_done(poll_scheduler* s, int id, uint64_t nowMs, uint32_t tookUs);
+extern void sched_set_interval(poll_scheduler* s, int id, uint32_t intervalMs);
+extern void sched_set_enabled(poll_scheduler* s, int id, bool enabled, uint64_t nowMs);
+extern void sched_end_tick(poll_scheduler* s);
+extern void sched_restart(poll_scheduler* s, uint64_t nowMs);
+extern void sched_get_stats(const poll_scheduler* s, int id, uint64_t nowMs, poll_stats* stats);
+
+#endif
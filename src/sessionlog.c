@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sessionlog.h"
+
+// worst case for one group: every channel, every value, five bytes each
+#define GROUP_MAX_VALUE_BYTES (SampleType_NumSampleTypes * SAMPLE_MAX_VALUES * SAMPLE_VARINT_MAX)
+
+static void end_block(session_log* log);
+static void write_index(session_log* log);
+static void emit(session_log* log, const void* data, uint32_t len);
+static void flush_out(session_log* log);
+static void emit_block_header(session_log* log, const log_block_header* h);
+static void put32(uint8_t* p, uint32_t v);
+static void put64(uint8_t* p, uint64_t v);
+static uint32_t get32(const uint8_t* p);
+static uint64_t get64(const uint8_t* p);
+
+session_log* sessionlog_open(const char* path, uint64_t startMs) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	session_log* log;
+
+	if(fd < 0) {
+		return NULL;
+	}
+
+	if(! (log = sessionlog_open_fd(fd, startMs))) {
+		close(fd);
+	}
+
+	return log;
+}
+
+// Nothing is ever seeked, so fd can be a pipe; the log takes ownership of it.
+session_log* sessionlog_open_fd(int fd, uint64_t startMs) {
+	session_log* log = calloc(1, sizeof(session_log));
+	uint8_t header[LOG_FILE_HEADER_SIZE];
+
+	if(! log) {
+		return NULL;
+	}
+
+	log->m_out = malloc(LOG_WRITE_CHUNK);
+	log->m_fd = fd;
+
+	if(! log->m_out) {
+		free(log);
+		return NULL;
+	}
+
+	put32(&header[0], LOG_FILE_MAGIC);
+	put32(&header[4], LOG_VERSION);
+	put64(&header[8], startMs);
+	emit(log, header, sizeof(header));
+
+	return log;
+}
+
+void sessionlog_append(session_log* log, uint64_t timeMs, const ecu_data* dat, uint32_t sampled) {
+	int type;
+
+	if(sampled == 0) {
+		return;
+	}
+
+	if((log->m_groups == LOG_BLOCK_GROUPS) || (log->m_valuesLen + GROUP_MAX_VALUE_BYTES > LOG_BLOCK_VALUE_BYTES)) {
+		end_block(log);
+	}
+
+	if(log->m_groups == 0) {
+		log->m_firstMs = timeMs;
+		log->m_prevMs = timeMs;
+		memset(log->m_prev, 0, sizeof(log->m_prev));
+	}
+
+	log->m_timeLen += sample_put_varint(&log->m_time[log->m_timeLen], sample_zigzag((int32_t)(timeMs - log->m_prevMs)));
+	log->m_maskLen += sample_put_varint(&log->m_mask[log->m_maskLen], sampled);
+	log->m_prevMs = timeMs;
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		int32_t values[SAMPLE_MAX_VALUES];
+		int i, n;
+
+		if(! (sampled & (1u << type))) {
+			continue;
+		}
+
+		n = sample_encode(dat, type, values);
+
+		for(i = 0; i < n; i++) {
+			log->m_valuesLen += sample_put_varint(&log->m_values[log->m_valuesLen], sample_zigzag(values[i] - log->m_prev[type][i]));
+			log->m_prev[type][i] = values[i];
+		}
+
+		log->m_samples++;
+	}
+
+	log->m_groups++;
+
+}
+
+bool sessionlog_close(session_log* log) {
+	uint8_t trailer[LOG_TRAILER_SIZE];
+	bool ok;
+
+	end_block(log);
+
+	if(log->m_indexCount > 0) {
+		write_index(log);
+	}
+
+	put64(&trailer[0], log->m_lastIndex);
+	put32(&trailer[8], LOG_TRAILER_MAGIC);
+	put32(&trailer[12], 0);
+	emit(log, trailer, sizeof(trailer));
+
+	flush_out(log);
+
+	ok = ! log->m_error && (close(log->m_fd) == 0);
+
+	free(log->m_out);
+	free(log);
+
+	return ok;
+}
+
+static void end_block(session_log* log) {
+	log_block_header header;
+
+	if(log->m_groups == 0) {
+		return;
+	}
+
+	header.m_magic = LOG_DATA_MAGIC;
+	header.m_length = log->m_timeLen + log->m_maskLen + log->m_valuesLen;
+	header.m_count = log->m_groups;
+	header.m_reserved = 0;
+	header.m_firstMs = log->m_firstMs;
+	header.m_lastMs = log->m_prevMs;
+	header.m_prevIndex = 0;
+
+	log->m_index[log->m_indexCount].m_firstMs = log->m_firstMs;
+	log->m_index[log->m_indexCount].m_offset = log->m_offset;
+	log->m_indexCount++;
+
+	emit_block_header(log, &header);
+	emit(log, log->m_time, log->m_timeLen);
+	emit(log, log->m_mask, log->m_maskLen);
+	emit(log, log->m_values, log->m_valuesLen);
+
+	log->m_groups = 0;
+	log->m_timeLen = 0;
+	log->m_maskLen = 0;
+	log->m_valuesLen = 0;
+
+	if(log->m_indexCount == LOG_INDEX_INTERVAL) {
+		write_index(log);
+	}
+
+}
+
+static void write_index(session_log* log) {
+	log_block_header header;
+	uint64_t offset = log->m_offset;
+	uint32_t i;
+
+	header.m_magic = LOG_INDEX_MAGIC;
+	header.m_length = log->m_indexCount * LOG_INDEX_ENTRY_SIZE;
+	header.m_count = log->m_indexCount;
+	header.m_reserved = 0;
+	header.m_firstMs = log->m_index[0].m_firstMs;
+	header.m_lastMs = log->m_index[log->m_indexCount - 1].m_firstMs;
+	header.m_prevIndex = log->m_lastIndex;
+
+	emit_block_header(log, &header);
+
+	for(i = 0; i < log->m_indexCount; i++) {
+		uint8_t entry[LOG_INDEX_ENTRY_SIZE];
+
+		put64(&entry[0], log->m_index[i].m_firstMs);
+		put64(&entry[8], log->m_index[i].m_offset);
+		emit(log, entry, sizeof(entry));
+	}
+
+	log->m_lastIndex = offset;
+	log->m_indexCount = 0;
+
+}
+
+// Queue bytes for the file; the card only sees whole LOG_WRITE_CHUNK writes until close.
+static void emit(session_log* log, const void* data, uint32_t len) {
+	const uint8_t* p = data;
+
+	while(len > 0) {
+		uint32_t n = LOG_WRITE_CHUNK - log->m_outLen;
+
+		if(n > len) {
+			n = len;
+		}
+
+		memcpy(&log->m_out[log->m_outLen], p, n);
+		log->m_outLen += n;
+		log->m_offset += n;
+		p += n;
+		len -= n;
+
+		if(log->m_outLen == LOG_WRITE_CHUNK) {
+			flush_out(log);
+		}
+	}
+
+}
+
+static void flush_out(session_log* log) {
+	uint32_t done = 0;
+
+	while(done < log->m_outLen) {
+		ssize_t n = write(log->m_fd, &log->m_out[done], log->m_outLen - done);
+
+		if(n <= 0) {
+			log->m_error = true;
+			break;
+		}
+
+		done += n;
+	}
+
+	log->m_bytes += done;
+	log->m_outLen = 0;
+
+}
+
+static void emit_block_header(session_log* log, const log_block_header* h) {
+	uint8_t p[LOG_BLOCK_HEADER_SIZE];
+
+	put32(&p[0], h->m_magic);
+	put32(&p[4], h->m_length);
+	put32(&p[8], h->m_count);
+	put32(&p[12], h->m_reserved);
+	put64(&p[16], h->m_firstMs);
+	put64(&p[24], h->m_lastMs);
+	put64(&p[32], h->m_prevIndex);
+	emit(log, p, sizeof(p));
+
+}
+
+void sessionlog_get_file_header(const uint8_t* p, log_file_header* h) {
+
+	h->m_magic = get32(&p[0]);
+	h->m_version = get32(&p[4]);
+	h->m_startMs = get64(&p[8]);
+
+}
+
+void sessionlog_get_block_header(const uint8_t* p, log_block_header* h) {
+
+	h->m_magic = get32(&p[0]);
+	h->m_length = get32(&p[4]);
+	h->m_count = get32(&p[8]);
+	h->m_reserved = get32(&p[12]);
+	h->m_firstMs = get64(&p[16]);
+	h->m_lastMs = get64(&p[24]);
+	h->m_prevIndex = get64(&p[32]);
+
+}
+
+void sessionlog_get_index_entry(const uint8_t* p, log_index_entry* e) {
+
+	e->m_firstMs = get64(&p[0]);
+	e->m_offset = get64(&p[8]);
+
+}
+
+void sessionlog_get_trailer(const uint8_t* p, log_trailer* t) {
+
+	t->m_lastIndex = get64(&p[0]);
+	t->m_magic = get32(&p[8]);
+	t->m_reserved = get32(&p[12]);
+
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+	int i;
+
+	for(i = 0; i < 4; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static void put64(uint8_t* p, uint64_t v) {
+	put32(p, (uint32_t)v);
+	put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t* p) {
+	return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
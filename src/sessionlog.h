@@ -0,0 +1,109 @@
+#ifndef SESSIONLOG_H
+#define SESSIONLOG_H
+
+#include "samples.h"
+
+/*
+ * Session log file layout (all integers little-endian, whatever the host;
+ * the structures below are only the in-memory form, written and read field
+ * by field):
+ *
+ *   log_file_header
+ *   data block, data block, ... index block, data block, ... index block
+ *   log_trailer (only present if the log was closed cleanly)
+ *
+ * A data block holds up to LOG_BLOCK_GROUPS groups, one per read_data()
+ * pass that sampled anything. Its payload is stored column by column:
+ *   - time: zigzag varint delta from the previous group (the first group
+ *     is relative to the block's m_firstMs)
+ *   - mask: varint bitmask of the SampleTypes sampled in the group
+ *   - values: for each group, for each set mask bit in ascending order,
+ *     sample_value_count() zigzag varints, each a delta against the last
+ *     value of that type and slot in the same block (starting from zero)
+ * so every data block decodes on its own.
+ *
+ * Every LOG_INDEX_INTERVAL data blocks (and on close) an index block lists
+ * the first timestamp and file offset of each data block since the last
+ * index block, and links back to that one through m_prevIndex.
+ */
+
+#define LOG_FILE_MAGIC		0x314C4452	// "RDL1"
+#define LOG_DATA_MAGIC		0x44424C52	// "RLBD"
+#define LOG_INDEX_MAGIC		0x49424C52	// "RLBI"
+#define LOG_TRAILER_MAGIC	0x45424C52	// "RLBE"
+#define LOG_VERSION		1
+
+#define LOG_BLOCK_GROUPS	256
+#define LOG_BLOCK_VALUE_BYTES	16384
+#define LOG_INDEX_INTERVAL	16
+#define LOG_WRITE_CHUNK		65536
+
+// Size of each structure in the file.
+#define LOG_FILE_HEADER_SIZE	16
+#define LOG_BLOCK_HEADER_SIZE	40
+#define LOG_INDEX_ENTRY_SIZE	16
+#define LOG_TRAILER_SIZE	16
+
+typedef struct log_file_header {
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint64_t m_startMs;
+	} log_file_header;
+
+typedef struct log_block_header {
+	uint32_t m_magic;
+	uint32_t m_length;
+	uint32_t m_count;
+	uint32_t m_reserved;
+	uint64_t m_firstMs;
+	uint64_t m_lastMs;
+	uint64_t m_prevIndex;
+	} log_block_header;
+
+typedef struct log_index_entry {
+	uint64_t m_firstMs;
+	uint64_t m_offset;
+	} log_index_entry;
+
+typedef struct log_trailer {
+	uint64_t m_lastIndex;
+	uint32_t m_magic;
+	uint32_t m_reserved;
+	} log_trailer;
+
+typedef struct session_log {
+	int m_fd;
+	uint64_t m_offset;
+	uint8_t* m_out;
+	uint32_t m_outLen;
+
+	uint8_t m_time[LOG_BLOCK_GROUPS * 5];
+	uint8_t m_mask[LOG_BLOCK_GROUPS * 5];
+	uint8_t m_values[LOG_BLOCK_VALUE_BYTES];
+	uint32_t m_timeLen;
+	uint32_t m_maskLen;
+	uint32_t m_valuesLen;
+	uint32_t m_groups;
+	uint64_t m_firstMs;
+	uint64_t m_prevMs;
+	int32_t m_prev[SampleType_NumSampleTypes][SAMPLE_MAX_VALUES];
+
+	log_index_entry m_index[LOG_INDEX_INTERVAL];
+	uint32_t m_indexCount;
+	uint64_t m_lastIndex;
+
+	uint64_t m_samples;
+	uint64_t m_bytes;
+	bool m_error;
+	} session_log;
+
+extern session_log* sessionlog_open(const char* path, uint64_t startMs);
+extern session_log* sessionlog_open_fd(int fd, uint64_t startMs);
+extern void sessionlog_append(session_log* log, uint64_t timeMs, const ecu_data* dat, uint32_t sampled);
+extern bool sessionlog_close(session_log* log);
+extern void sessionlog_get_file_header(const uint8_t* p, log_file_header* h);
+extern void sessionlog_get_block_header(const uint8_t* p, log_block_header* h);
+extern void sessionlog_get_index_entry(const uint8_t* p, log_index_entry* e);
+extern void sessionlog_get_trailer(const uint8_t* p, log_trailer* t);
+
+#endif
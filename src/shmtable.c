@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmtable.h"
+
+/*
+ * The writer is whichever thread owns the ECU link; it publishes after each
+ * read_data() pass, touching only the channels that pass sampled. Readers
+ * map the segment read only, so a misbehaving reader cannot disturb it.
+ */
+
+static shm_table* map_table(const char* name, int fd, bool writer);
+
+shm_table* shmtable_create(const char* name) {
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	shm_table* t;
+
+	if(fd < 0) {
+		return NULL;
+	}
+
+	if(ftruncate(fd, sizeof(shm_layout)) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	t = map_table(name, fd, true);
+
+	if(t) {
+		// a previous writer's values are not ours; start every channel from scratch
+		memset(t->m_map, 0, sizeof(shm_layout));
+		t->m_map->m_header.m_version = SHM_TABLE_VERSION;
+		t->m_map->m_header.m_channels = SampleType_NumSampleTypes;
+		t->m_map->m_header.m_writerPid = getpid();
+		t->m_map->m_header.m_startMs = wallclock_ms();
+		__atomic_store_n(&t->m_map->m_header.m_magic, SHM_TABLE_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	return t;
+}
+
+shm_table* shmtable_attach(const char* name) {
+	int fd = shm_open(name, O_RDONLY, 0);
+	shm_table* t;
+	struct stat st;
+
+	if(fd < 0) {
+		return NULL;
+	}
+
+	if((fstat(fd, &st) != 0) || (st.st_size < sizeof(shm_layout))) {
+		close(fd);
+		return NULL;
+	}
+
+	t = map_table(name, fd, false);
+
+	if(t && ((__atomic_load_n(&t->m_map->m_header.m_magic, __ATOMIC_ACQUIRE) != SHM_TABLE_MAGIC) ||
+		(t->m_map->m_header.m_version != SHM_TABLE_VERSION) || (t->m_map->m_header.m_channels != SampleType_NumSampleTypes))) {
+		shmtable_close(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void shmtable_publish(shm_table* t, uint64_t timeMs, const ecu_data* dat) {
+	int type;
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		shm_channel* ch = &t->m_map->m_channel[type];
+		uint32_t s;
+
+		if(! (dat->m_sampled & (1u << type))) {
+			continue;
+		}
+
+		s = __atomic_load_n(&ch->m_seq, __ATOMIC_RELAXED);
+		__atomic_store_n(&ch->m_seq, s + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		ch->m_timeMs = timeMs;
+		sample_encode(dat, type, ch->m_values);
+
+		__atomic_store_n(&ch->m_seq, s + 2, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&t->m_map->m_header.m_heartbeatMs, timeMs - t->m_map->m_header.m_startMs, __ATOMIC_RELAXED);
+
+}
+
+// A torn result means the writer kept overtaking us; try again later rather than spin.
+shm_read_result shmtable_read(const shm_table* t, SampleType type, shm_sample* out) {
+	const shm_channel* ch = &t->m_map->m_channel[type];
+	uint32_t before, after;
+	int tries;
+
+	for(tries = 0; tries < SHM_READ_RETRIES; tries++) {
+		before = __atomic_load_n(&ch->m_seq, __ATOMIC_ACQUIRE);
+
+		if(before == 0) {
+			return shmread_never;
+		}
+
+		if(before & 1) {
+			continue;
+		}
+
+		out->m_timeMs = ch->m_timeMs;
+		memcpy(out->m_values, ch->m_values, sizeof(out->m_values));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&ch->m_seq, __ATOMIC_RELAXED);
+
+		if(before == after) {
+			out->m_seq = before / 2;
+			return shmread_ok;
+		}
+	}
+
+	return shmread_torn;
+}
+
+uint64_t shmtable_heartbeat(const shm_table* t) {
+	return t->m_map->m_header.m_startMs + __atomic_load_n(&t->m_map->m_header.m_heartbeatMs, __ATOMIC_RELAXED);
+}
+
+// The writer removes the name; readers that still have it mapped keep their view.
+void shmtable_close(shm_table* t) {
+
+	munmap(t->m_map, sizeof(shm_layout));
+
+	if(t->m_writer) {
+		shm_unlink(t->m_name);
+	}
+
+	free(t);
+
+}
+
+static shm_table* map_table(const char* name, int fd, bool writer) {
+	shm_table* t = calloc(1, sizeof(shm_table));
+
+	if(t) {
+		t->m_map = mmap(NULL, sizeof(shm_layout), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+		if(t->m_map == MAP_FAILED) {
+			free(t);
+			t = NULL;
+		}
+		else {
+			snprintf(t->m_name, sizeof(t->m_name), "%s", name);
+			t->m_writer = writer;
+		}
+	}
+
+	close(fd);
+
+	return t;
+}
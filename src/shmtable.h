@@ -0,0 +1,73 @@
+#ifndef SHMTABLE_H
+#define SHMTABLE_H
+
+#include "samples.h"
+
+/*
+ * Latest-value table in POSIX shared memory, so any local process can read
+ * the current samples with a few loads. One shm_channel per SampleType,
+ * each under its own seqlock: m_seq is odd while the writer is updating
+ * that channel and goes up by two per update, so m_seq / 2 is the number
+ * of updates so far. A reader that sees the same even m_seq before and
+ * after copying has a consistent entry; the writer never waits for anyone.
+ *
+ * Values are sample_encode() integers. m_heartbeatMs (relative to
+ * m_startMs, to stay a 32 bit store) is refreshed on every pass, so a
+ * reader can tell a dead writer from a channel that is simply polled
+ * slowly.
+ */
+
+#define SHM_TABLE_MAGIC		0x31545352	// "RST1"
+#define SHM_TABLE_VERSION	1
+#define SHM_READ_RETRIES	8
+
+typedef struct shm_channel {
+	uint32_t m_seq;
+	uint32_t m_reserved;
+	uint64_t m_timeMs;
+	int32_t m_values[SAMPLE_MAX_VALUES];
+	uint8_t m_pad[8];
+	} shm_channel;
+
+typedef struct shm_header {
+	uint32_t m_magic;
+	uint32_t m_version;
+	uint32_t m_channels;
+	uint32_t m_writerPid;
+	uint64_t m_startMs;
+	uint32_t m_heartbeatMs;
+	uint32_t m_reserved;
+	} shm_header;
+
+typedef struct shm_layout {
+	shm_header m_header;
+	shm_channel m_channel[SampleType_NumSampleTypes];
+	} shm_layout;
+
+typedef struct shm_table {
+	shm_layout* m_map;
+	char m_name[64];
+	bool m_writer;
+	} shm_table;
+
+// What a reader gets for one channel; m_seq is the update count.
+typedef struct shm_sample {
+	uint32_t m_seq;
+	uint64_t m_timeMs;
+	int32_t m_values[SAMPLE_MAX_VALUES];
+	} shm_sample;
+
+typedef enum shm_read_result {
+	shmread_ok,
+	shmread_never,
+	shmread_torn
+	} shm_read_result;
+
+extern shm_table* shmtable_create(const char* name);
+extern shm_table* shmtable_attach(const char* name);
+extern void shmtable_publish(shm_table* t, uint64_t timeMs, const ecu_data* dat);
+extern shm_read_result shmtable_read(const shm_table* t, SampleType type, shm_sample* out);
+extern uint64_t shmtable_heartbeat(const shm_table* t);
+extern void shmtable_close(shm_table* t);
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "stream.h"
+
+static uint32_t format_value(char* buf, int32_t value, int32_t scale);
+static void write_header(sample_stream* s);
+static void flush_out(sample_stream* s);
+
+static const char* const formatNames[] = {
+	[streamformat_csv]   = "csv",
+	[streamformat_jsonl] = "jsonl",
+	[streamformat_bin]   = "bin"
+	};
+
+bool stream_parse_format(const char* name, stream_format* format) {
+	int i;
+
+	for(i = 0; i < sizeof(formatNames) / sizeof(formatNames[0]); i++) {
+		if(strcmp(name, formatNames[i]) == 0) {
+			*format = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+sample_stream* stream_open(int fd, stream_format format, uint64_t startMs) {
+	sample_stream* s = calloc(1, sizeof(sample_stream));
+
+	if(! s) {
+		return NULL;
+	}
+
+	s->m_format = format;
+	s->m_fd = fd;
+
+	if(format == streamformat_bin) {
+		s->m_log = sessionlog_open_fd(fd, startMs);
+	}
+	else {
+		s->m_out = malloc(STREAM_WRITE_CHUNK);
+	}
+
+	if(! s->m_log && ! s->m_out) {
+		free(s);
+		return NULL;
+	}
+
+	if(format == streamformat_csv) {
+		write_header(s);
+	}
+
+	return s;
+}
+
+// False once the reader has gone away, or anything else stops the output.
+bool stream_write(sample_stream* s, uint64_t timeMs, const ecu_data* dat) {
+	char* p;
+	int type, i;
+
+	if(dat->m_sampled == 0) {
+		return ! s->m_error;
+	}
+
+	s->m_records++;
+
+	if(s->m_log) {
+		sessionlog_append(s->m_log, timeMs, dat, dat->m_sampled);
+		s->m_error = s->m_log->m_error;
+		return ! s->m_error;
+	}
+
+	if(s->m_outLen + STREAM_RECORD_MAX > STREAM_WRITE_CHUNK) {
+		flush_out(s);
+	}
+
+	p = &s->m_out[s->m_outLen];
+	p += sprintf(p, (s->m_format == streamformat_csv) ? "%llu" : "{\"time_ms\":%llu", (unsigned long long)timeMs);
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		int32_t values[SAMPLE_MAX_VALUES];
+		int n = sample_value_count(type);
+		bool sampled = dat->m_sampled & (1u << type);
+
+		if(sampled) {
+			sample_encode(dat, type, values);
+		}
+
+		for(i = 0; i < n; i++) {
+			if(s->m_format == streamformat_csv) {
+				*p++ = ',';
+
+				if(sampled) {
+					p += format_value(p, values[i], sample_value_scale(type, i));
+				}
+			}
+			else if(sampled) {
+				p += sprintf(p, ",\"%s\":", sample_value_name(type, i));
+				p += format_value(p, values[i], sample_value_scale(type, i));
+			}
+		}
+	}
+
+	if(s->m_format == streamformat_jsonl) {
+		*p++ = '}';
+	}
+
+	*p++ = '\n';
+	s->m_outLen = p - s->m_out;
+
+	if(timeMs - s->m_flushedMs >= STREAM_FLUSH_MS) {
+		flush_out(s);
+		s->m_flushedMs = timeMs;
+	}
+
+	return ! s->m_error;
+}
+
+bool stream_close(sample_stream* s) {
+	bool ok;
+
+	if(s->m_log) {
+		ok = sessionlog_close(s->m_log);
+	}
+	else {
+		flush_out(s);
+		ok = ! s->m_error;
+		free(s->m_out);
+	}
+
+	free(s);
+
+	return ok;
+}
+
+// Integer arithmetic only, so the text is exactly what was encoded.
+static uint32_t format_value(char* buf, int32_t value, int32_t scale) {
+	uint32_t magnitude = (value < 0) ? -(uint32_t)value : value;
+	int digits = 0;
+	int32_t s;
+
+	if(scale == 1) {
+		return sprintf(buf, "%d", value);
+	}
+
+	for(s = scale; (s > 1) && (digits < 9); s /= 10) {
+		digits++;
+	}
+
+	return sprintf(buf, "%s%u.%0*u", (value < 0) ? "-" : "", magnitude / scale, digits, magnitude % scale);
+}
+
+static void write_header(sample_stream* s) {
+	char* p = s->m_out;
+	int type, i;
+
+	p += sprintf(p, "time_ms");
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		for(i = 0; i < sample_value_count(type); i++) {
+			p += sprintf(p, ",%s", sample_value_name(type, i));
+		}
+	}
+
+	*p++ = '\n';
+	s->m_outLen = p - s->m_out;
+
+}
+
+static void flush_out(sample_stream* s) {
+	uint32_t done = 0;
+
+	while(! s->m_error && (done < s->m_outLen)) {
+		ssize_t n = write(s->m_fd, &s->m_out[done], s->m_outLen - done);
+
+		if((n < 0) && (errno == EINTR)) {
+			continue;
+		}
+
+		if(n <= 0) {
+			s->m_error = true;
+			break;
+		}
+
+		done += n;
+	}
+
+	s->m_bytes += done;
+	s->m_outLen = 0;
+
+}
@@ -0,0 +1,51 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "sessionlog.h"
+
+/*
+ * Headless sample streams: every read_data() pass that sampled anything
+ * becomes one record on a file descriptor, for feeding other tools.
+ *
+ *   csv    a header row, then one row per pass: time_ms and a column per
+ *          value (see sample_value_name()); channels not sampled in that
+ *          pass are left empty
+ *   jsonl  one object per pass holding "time_ms" and the sampled values
+ *   bin    a session log (sessionlog.h), written as a stream
+ *
+ * Times are wall clock milliseconds. Text values are in ecu_data's units,
+ * printed exactly from the sample_encode() integers. Text goes out in
+ * STREAM_WRITE_CHUNK blocks, or at least every STREAM_FLUSH_MS so a slow
+ * link still reaches the reader promptly; bin is flushed as the session
+ * log is.
+ */
+
+#define STREAM_WRITE_CHUNK	65536
+#define STREAM_FLUSH_MS		1000
+// worst case for one text record: every value at its widest, plus names
+#define STREAM_RECORD_MAX	2048
+
+typedef enum stream_format {
+	streamformat_csv,
+	streamformat_jsonl,
+	streamformat_bin
+	} stream_format;
+
+typedef struct sample_stream {
+	stream_format m_format;
+	int m_fd;
+	session_log* m_log;
+	char* m_out;
+	uint32_t m_outLen;
+	uint64_t m_flushedMs;
+	uint64_t m_records;
+	uint64_t m_bytes;
+	bool m_error;
+	} sample_stream;
+
+extern bool stream_parse_format(const char* name, stream_format* format);
+extern sample_stream* stream_open(int fd, stream_format format, uint64_t startMs);
+extern bool stream_write(sample_stream* s, uint64_t timeMs, const ecu_data* dat);
+extern bool stream_close(sample_stream* s);
+
+#endif
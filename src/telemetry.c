@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "telemetry.h"
+
+/*
+ * Both ends of the telemetry stream. The server is single threaded and is
+ * driven by whoever owns the ECU link: publish() after each read_data()
+ * pass, service() whenever there is time to spare. Each pass is encoded
+ * once per channel and the per-subscriber frames are stitched together
+ * from those pieces.
+ */
+
+static int open_socket(const char* addr, bool listening, char* path, size_t len);
+static void set_nonblocking(int fd);
+static void drop_client(telem_server* s, int i);
+static void queue_frame(telem_server* s, telem_subscriber* sub, uint8_t type, uint8_t flags, const void* payload, uint32_t len);
+static void flush_client(telem_server* s, int i);
+static void read_client(telem_server* s, int i);
+static void make_info(const ecu_data* dat, telem_info* info);
+static bool send_all(int fd, const void* data, uint32_t len);
+
+telem_server* telem_server_open(const char* addr) {
+	telem_server* s = calloc(1, sizeof(telem_server));
+
+	if(! s) {
+		return NULL;
+	}
+
+	s->m_fd = open_socket(addr, true, s->m_path, sizeof(s->m_path));
+
+	if(s->m_fd < 0) {
+		free(s);
+		return NULL;
+	}
+
+	set_nonblocking(s->m_fd);
+	s->m_startMs = wallclock_ms();
+
+	return s;
+}
+
+void telem_server_publish(telem_server* s, uint64_t timeMs, const ecu_data* dat, read_result result) {
+	uint8_t values[TELEM_MAX_VALUE_BYTES];
+	uint16_t offsets[SampleType_NumSampleTypes + 1];
+	uint8_t frame[sizeof(telem_samples) + TELEM_MAX_VALUE_BYTES];
+	telem_samples* head = (telem_samples*)frame;
+	telem_info info;
+	uint32_t len = 0;
+	int type, i;
+
+	make_info(dat, &info);
+
+	if(memcmp(&info, &s->m_info, sizeof(info)) != 0) {
+		s->m_info = info;
+
+		for(i = 0; i < TELEM_MAX_CLIENTS; i++) {
+			if(s->m_clients[i] && s->m_clients[i]->m_mask) {
+				queue_frame(s, s->m_clients[i], telemframe_info, 0, &info, sizeof(info));
+			}
+		}
+	}
+
+	s->m_seq++;
+
+	if(dat->m_sampled == 0) {
+		return;
+	}
+
+	for(type = 0; type < SampleType_NumSampleTypes; type++) {
+		offsets[type] = len;
+
+		if(dat->m_sampled & (1u << type)) {
+			int32_t v[SAMPLE_MAX_VALUES];
+			int n = sample_encode(dat, type, v);
+
+			for(i = 0; i < n; i++) {
+				len += sample_put_varint(&values[len], sample_zigzag(v[i]));
+			}
+		}
+	}
+
+	offsets[SampleType_NumSampleTypes] = len;
+
+	for(i = 0; i < TELEM_MAX_CLIENTS; i++) {
+		telem_subscriber* sub = s->m_clients[i];
+		uint32_t mask, n;
+
+		if(! sub || ! (mask = sub->m_mask & dat->m_sampled)) {
+			continue;
+		}
+
+		if(sub->m_skip > 0) {
+			sub->m_skip--;
+			continue;
+		}
+
+		sub->m_skip = sub->m_decimation - 1;
+
+		head->m_seq = s->m_seq;
+		head->m_timeMs = timeMs - s->m_startMs;
+		head->m_mask = mask;
+		n = sizeof(telem_samples);
+
+		for(type = 0; type < SampleType_NumSampleTypes; type++) {
+			if(mask & (1u << type)) {
+				memcpy(&frame[n], &values[offsets[type]], offsets[type + 1] - offsets[type]);
+				n += offsets[type + 1] - offsets[type];
+			}
+		}
+
+		queue_frame(s, sub, telemframe_samples, result, frame, n);
+		flush_client(s, i);
+	}
+
+}
+
+// Accept, take subscriptions and drain output buffers, waiting up to timeoutMs for something to do.
+void telem_server_service(telem_server* s, int timeoutMs) {
+	struct pollfd fds[TELEM_MAX_CLIENTS + 1];
+	int which[TELEM_MAX_CLIENTS + 1];
+	int n = 0;
+	int i;
+
+	fds[n].fd = s->m_fd;
+	fds[n].events = POLLIN;
+	which[n++] = -1;
+
+	for(i = 0; i < TELEM_MAX_CLIENTS; i++) {
+		if(s->m_clients[i]) {
+			fds[n].fd = s->m_clients[i]->m_fd;
+			fds[n].events = POLLIN | (s->m_clients[i]->m_outLen ? POLLOUT : 0);
+			which[n++] = i;
+		}
+	}
+
+	if(poll(fds, n, timeoutMs) <= 0) {
+		return;
+	}
+
+	for(i = 1; i < n; i++) {
+		int c = which[i];
+
+		if(fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+			read_client(s, c);
+		}
+
+		if(s->m_clients[c] && (fds[i].revents & POLLOUT)) {
+			flush_client(s, c);
+		}
+	}
+
+	if(fds[0].revents & POLLIN) {
+		int fd = accept(s->m_fd, NULL, NULL);
+		telem_hello hello;
+
+		if(fd < 0) {
+			return;
+		}
+
+		for(i = 0; (i < TELEM_MAX_CLIENTS) && s->m_clients[i]; i++);
+
+		if((i == TELEM_MAX_CLIENTS) || ! (s->m_clients[i] = calloc(1, sizeof(telem_subscriber)))) {
+			close(fd);
+			return;
+		}
+
+		set_nonblocking(fd);
+		s->m_clients[i]->m_fd = fd;
+		s->m_clients[i]->m_decimation = 1;
+		s->m_accepted++;
+
+		hello.m_magic = TELEM_MAGIC;
+		hello.m_version = TELEM_VERSION;
+		hello.m_channels = SampleType_NumSampleTypes;
+		hello.m_startMs = s->m_startMs;
+		queue_frame(s, s->m_clients[i], telemframe_hello, 0, &hello, sizeof(hello));
+		flush_client(s, i);
+	}
+
+}
+
+void telem_server_close(telem_server* s) {
+	int i;
+
+	for(i = 0; i < TELEM_MAX_CLIENTS; i++) {
+		if(s->m_clients[i]) {
+			drop_client(s, i);
+		}
+	}
+
+	close(s->m_fd);
+
+	if(s->m_path[0]) {
+		unlink(s->m_path);
+	}
+
+	free(s);
+
+}
+
+void print_telem_stats(telem_server* s, FILE* f) {
+	int i;
+
+	fprintf(f, "Telemetry: %u passes, %u subscribers accepted, %u frames sent, %u dropped\n", s->m_seq, s->m_accepted, s->m_sent, s->m_dropped);
+
+	for(i = 0; i < TELEM_MAX_CLIENTS; i++) {
+		telem_subscriber* sub = s->m_clients[i];
+
+		if(sub) {
+			fprintf(f, "  subscriber %d: mask %05x, every %u, %u frames sent, %u dropped\n", i, sub->m_mask, sub->m_decimation, sub->m_sent, sub->m_dropped);
+		}
+	}
+
+}
+
+telem_client* telem_client_open(const char* addr, uint32_t mask, uint16_t decimation) {
+	telem_client* tc = calloc(1, sizeof(telem_client));
+	struct {
+		telem_frame_header header;
+		telem_subscribe sub;
+		} req;
+
+	if(! tc) {
+		return NULL;
+	}
+
+	tc->m_fd = open_socket(addr, false, NULL, 0);
+
+	req.header.m_length = sizeof(req.sub);
+	req.header.m_type = telemframe_subscribe;
+	req.header.m_flags = 0;
+	req.sub.m_mask = mask;
+	req.sub.m_decimation = decimation;
+	req.sub.m_reserved = 0;
+
+	if((tc->m_fd < 0) || ! send_all(tc->m_fd, &req, sizeof(req))) {
+		if(tc->m_fd >= 0) close(tc->m_fd);
+		free(tc);
+		return NULL;
+	}
+
+	set_nonblocking(tc->m_fd);
+
+	return tc;
+}
+
+// Decode everything that has arrived; returns the result of the last samples frame, if any.
+read_result telem_client_read(telem_client* tc, ecu_data* dat) {
+	read_result result = readresult_nostatement;
+	uint32_t done = 0;
+	ssize_t got;
+
+	if(tc->m_fd < 0) {
+		return result;
+	}
+
+	while((got = recv(tc->m_fd, &tc->m_in[tc->m_inLen], TELEM_BUFFER - tc->m_inLen, 0)) > 0) {
+		tc->m_inLen += got;
+
+		if(tc->m_inLen == TELEM_BUFFER) {
+			break;
+		}
+	}
+
+	if((got == 0) || ((got < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+		close(tc->m_fd);
+		tc->m_fd = -1;
+	}
+
+	while(tc->m_inLen - done >= sizeof(telem_frame_header)) {
+		telem_frame_header header;
+		const uint8_t* p;
+		const uint8_t* end;
+
+		memcpy(&header, &tc->m_in[done], sizeof(header));
+
+		if(tc->m_inLen - done < sizeof(header) + header.m_length) {
+			break;
+		}
+
+		p = &tc->m_in[done + sizeof(header)];
+		end = p + header.m_length;
+		done += sizeof(header) + header.m_length;
+
+		if(header.m_type == telemframe_hello) {
+			telem_hello hello;
+
+			memcpy(&hello, p, (header.m_length < sizeof(hello)) ? header.m_length : sizeof(hello));
+
+			if((header.m_length < sizeof(hello)) || (hello.m_magic != TELEM_MAGIC) || (hello.m_version != TELEM_VERSION)) {
+				close(tc->m_fd);
+				tc->m_fd = -1;
+				tc->m_inLen = 0;
+				return readresult_failure;
+			}
+
+			tc->m_helloSeen = true;
+			tc->m_startMs = hello.m_startMs;
+		}
+		else if((header.m_type == telemframe_info) && (header.m_length >= sizeof(telem_info))) {
+			telem_info info;
+
+			memcpy(&info, p, sizeof(info));
+			dat->m_readTuneId = info.m_flags & TELEM_INFO_TUNE;
+			dat->m_tune = info.m_tune;
+			dat->m_ident = info.m_ident;
+			dat->m_checksumFixer = info.m_checksumFixer;
+			dat->m_romRead = info.m_flags & TELEM_INFO_ROM;
+			dat->m_rpmLimitRead = info.m_flags & TELEM_INFO_RPM_LIMIT;
+			dat->m_rpmLimit = info.m_rpmLimit;
+		}
+		else if((header.m_type == telemframe_samples) && (header.m_length >= sizeof(telem_samples))) {
+			telem_samples head;
+			int type, i;
+
+			memcpy(&head, p, sizeof(head));
+			p += sizeof(head);
+
+			if(tc->m_frames && (head.m_seq != tc->m_lastSeq + 1)) {
+				tc->m_gaps++;
+			}
+
+			tc->m_lastSeq = head.m_seq;
+			tc->m_frames++;
+
+			for(type = 0; (type < SampleType_NumSampleTypes) && p; type++) {
+				int32_t values[SAMPLE_MAX_VALUES];
+
+				if(! (head.m_mask & (1u << type))) {
+					continue;
+				}
+
+				for(i = 0; (i < sample_value_count(type)) && p; i++) {
+					uint32_t v;
+
+					if((p = sample_get_varint(p, end, &v))) {
+						values[i] = sample_unzigzag(v);
+					}
+				}
+
+				if(p) {
+					sample_decode(dat, type, values);
+				}
+			}
+
+			dat->m_sampled = head.m_mask;
+			result = header.m_flags;
+		}
+	}
+
+	memmove(tc->m_in, &tc->m_in[done], tc->m_inLen - done);
+	tc->m_inLen -= done;
+
+	return result;
+}
+
+bool telem_client_connected(const telem_client* tc) {
+	return tc->m_fd >= 0;
+}
+
+void telem_client_close(telem_client* tc) {
+
+	if(tc->m_fd >= 0) {
+		close(tc->m_fd);
+	}
+
+	free(tc);
+
+}
+
+// "tcp:<port>" is loopback TCP, anything else a Unix socket path.
+static int open_socket(const char* addr, bool listening, char* path, size_t len) {
+	int fd;
+
+	if(strncmp(addr, TELEM_TCP_PREFIX, strlen(TELEM_TCP_PREFIX)) == 0) {
+		struct sockaddr_in sin;
+		int one = 1;
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(atoi(addr + strlen(TELEM_TCP_PREFIX)));
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+			return -1;
+		}
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		if(listening) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		}
+
+		if(listening ? (bind(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0) || (listen(fd, TELEM_MAX_CLIENTS) != 0) :
+			(connect(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0)) {
+			close(fd);
+			return -1;
+		}
+	}
+	else {
+		struct sockaddr_un sun;
+
+		if(strlen(addr) >= sizeof(sun.sun_path)) {
+			return -1;
+		}
+
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, addr);
+
+		if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+			return -1;
+		}
+
+		if(listening) {
+			// a socket left behind by a daemon that did not exit cleanly
+			unlink(addr);
+		}
+
+		if(listening ? (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0) || (listen(fd, TELEM_MAX_CLIENTS) != 0) :
+			(connect(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0)) {
+			close(fd);
+			return -1;
+		}
+
+		if(path) {
+			snprintf(path, len, "%s", addr);
+		}
+	}
+
+	return fd;
+}
+
+static void set_nonblocking(int fd) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static void drop_client(telem_server* s, int i) {
+
+	close(s->m_clients[i]->m_fd);
+	free(s->m_clients[i]);
+	s->m_clients[i] = NULL;
+
+}
+
+static void queue_frame(telem_server* s, telem_subscriber* sub, uint8_t type, uint8_t flags, const void* payload, uint32_t len) {
+	telem_frame_header header;
+
+	if(sub->m_outLen + sizeof(header) + len > TELEM_BUFFER) {
+		sub->m_dropped++;
+		s->m_dropped++;
+		return;
+	}
+
+	header.m_length = len;
+	header.m_type = type;
+	header.m_flags = flags;
+	memcpy(&sub->m_out[sub->m_outLen], &header, sizeof(header));
+	memcpy(&sub->m_out[sub->m_outLen + sizeof(header)], payload, len);
+	sub->m_outLen += sizeof(header) + len;
+	sub->m_sent++;
+	s->m_sent++;
+
+}
+
+static void flush_client(telem_server* s, int i) {
+	telem_subscriber* sub = s->m_clients[i];
+	ssize_t n;
+
+	if(sub->m_outLen == 0) {
+		return;
+	}
+
+	n = send(sub->m_fd, sub->m_out, sub->m_outLen, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+	if(n > 0) {
+		memmove(sub->m_out, &sub->m_out[n], sub->m_outLen - n);
+		sub->m_outLen -= n;
+	}
+	else if((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+		drop_client(s, i);
+	}
+
+}
+
+static void read_client(telem_server* s, int i) {
+	telem_subscriber* sub = s->m_clients[i];
+	uint32_t done = 0;
+	ssize_t n;
+
+	n = recv(sub->m_fd, &sub->m_in[sub->m_inLen], TELEM_IN_BUFFER - sub->m_inLen, MSG_DONTWAIT);
+
+	if((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+		drop_client(s, i);
+		return;
+	}
+
+	if(n < 0) {
+		return;
+	}
+
+	sub->m_inLen += n;
+
+	while(sub->m_inLen - done >= sizeof(telem_frame_header)) {
+		telem_frame_header header;
+
+		memcpy(&header, &sub->m_in[done], sizeof(header));
+
+		if(sizeof(header) + header.m_length > TELEM_IN_BUFFER) {
+			// nothing a client sends is this long
+			drop_client(s, i);
+			return;
+		}
+
+		if(sub->m_inLen - done < sizeof(header) + header.m_length) {
+			break;
+		}
+
+		if((header.m_type == telemframe_subscribe) && (header.m_length >= sizeof(telem_subscribe))) {
+			telem_subscribe req;
+
+			memcpy(&req, &sub->m_in[done + sizeof(header)], sizeof(req));
+			sub->m_mask = req.m_mask & TELEM_ALL_CHANNELS;
+			sub->m_decimation = (req.m_decimation < 1) ? 1 : (req.m_decimation > TELEM_MAX_DECIMATION) ? TELEM_MAX_DECIMATION : req.m_decimation;
+			sub->m_skip = 0;
+			queue_frame(s, sub, telemframe_info, 0, &s->m_info, sizeof(s->m_info));
+		}
+
+		done += sizeof(header) + header.m_length;
+	}
+
+	memmove(sub->m_in, &sub->m_in[done], sub->m_inLen - done);
+	sub->m_inLen -= done;
+
+}
+
+static void make_info(const ecu_data* dat, telem_info* info) {
+
+	memset(info, 0, sizeof(*info));
+	info->m_flags = (dat->m_readTuneId ? TELEM_INFO_TUNE : 0) | (dat->m_romRead ? TELEM_INFO_ROM : 0) | (dat->m_rpmLimitRead ? TELEM_INFO_RPM_LIMIT : 0);
+	info->m_tune = dat->m_tune;
+	info->m_ident = dat->m_ident;
+	info->m_checksumFixer = dat->m_checksumFixer;
+	info->m_rpmLimit = dat->m_rpmLimit;
+
+}
+
+static bool send_all(int fd, const void* data, uint32_t len) {
+	const uint8_t* p = data;
+
+	while(len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+		if(n <= 0) {
+			return false;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return true;
+}
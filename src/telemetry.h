@@ -0,0 +1,129 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "samples.h"
+
+/*
+ * Telemetry stream: one process owns the ECU link and fans its samples out
+ * to any number of subscribers over a Unix domain socket, or over loopback
+ * TCP when the address is written "tcp:<port>". Every message is a
+ * telem_frame_header followed by m_length payload bytes (integers
+ * little-endian):
+ *
+ *   hello (server, on accept): telem_hello
+ *   subscribe (client, at any time): telem_subscribe
+ *   info (server, on subscribe and whenever it changes): telem_info
+ *   samples (server, per read_data() pass): telem_samples, then for each
+ *     set mask bit in ascending order sample_value_count() zigzag varints
+ *     holding absolute values, so every frame decodes on its own. m_flags
+ *     carries the pass's read_result.
+ *
+ * A subscriber is only sent passes that sampled one of its channels, and
+ * of those only every m_decimation'th. The server never waits for a
+ * subscriber: a frame that does not fit in its output buffer is dropped
+ * and counted.
+ */
+
+#define TELEM_MAGIC		0x31544452	// "RDT1"
+#define TELEM_VERSION		2
+#define TELEM_TCP_PREFIX	"tcp:"
+#define TELEM_MAX_CLIENTS	16
+#define TELEM_BUFFER		16384
+#define TELEM_IN_BUFFER		64
+#define TELEM_MAX_DECIMATION	1000
+#define TELEM_ALL_CHANNELS	((1u << SampleType_NumSampleTypes) - 1)
+
+#define TELEM_INFO_TUNE		0x01
+#define TELEM_INFO_ROM		0x02
+#define TELEM_INFO_RPM_LIMIT	0x04
+
+typedef enum telem_frame_type {
+	telemframe_hello,
+	telemframe_subscribe,
+	telemframe_info,
+	telemframe_samples
+	} telem_frame_type;
+
+typedef struct telem_frame_header {
+	uint16_t m_length;
+	uint8_t m_type;
+	uint8_t m_flags;
+	} telem_frame_header;
+
+typedef struct telem_hello {
+	uint32_t m_magic;
+	uint16_t m_version;
+	uint16_t m_channels;
+	uint64_t m_startMs;
+	} telem_hello;
+
+typedef struct telem_subscribe {
+	uint32_t m_mask;
+	uint16_t m_decimation;
+	uint16_t m_reserved;
+	} telem_subscribe;
+
+typedef struct telem_info {
+	uint16_t m_tune;
+	uint16_t m_ident;
+	uint8_t m_checksumFixer;
+	uint8_t m_flags;
+	uint16_t m_rpmLimit;
+	} telem_info;
+
+typedef struct telem_samples {
+	uint32_t m_seq;
+	uint32_t m_timeMs;	// since telem_hello.m_startMs
+	uint32_t m_mask;
+	} telem_samples;
+
+#define TELEM_MAX_VALUE_BYTES	(SampleType_NumSampleTypes * SAMPLE_MAX_VALUES * SAMPLE_VARINT_MAX)
+
+typedef struct telem_subscriber {
+	int m_fd;
+	uint32_t m_mask;
+	uint16_t m_decimation;
+	uint16_t m_skip;
+	uint8_t m_in[TELEM_IN_BUFFER];
+	uint32_t m_inLen;
+	uint8_t m_out[TELEM_BUFFER];
+	uint32_t m_outLen;
+	uint32_t m_sent;
+	uint32_t m_dropped;
+	} telem_subscriber;
+
+typedef struct telem_server {
+	int m_fd;
+	char m_path[108];
+	uint64_t m_startMs;
+	uint32_t m_seq;
+	telem_info m_info;
+	telem_subscriber* m_clients[TELEM_MAX_CLIENTS];
+	uint32_t m_accepted;
+	uint32_t m_sent;
+	uint32_t m_dropped;
+	} telem_server;
+
+typedef struct telem_client {
+	int m_fd;
+	bool m_helloSeen;
+	uint64_t m_startMs;
+	uint32_t m_lastSeq;
+	uint32_t m_frames;
+	uint32_t m_gaps;
+	uint8_t m_in[TELEM_BUFFER];
+	uint32_t m_inLen;
+	} telem_client;
+
+extern telem_server* telem_server_open(const char* addr);
+extern void telem_server_publish(telem_server* s, uint64_t timeMs, const ecu_data* dat, read_result result);
+extern void telem_server_service(telem_server* s, int timeoutMs);
+extern void telem_server_close(telem_server* s);
+extern void print_telem_stats(telem_server* s, FILE* f);
+
+extern telem_client* telem_client_open(const char* addr, uint32_t mask, uint16_t decimation);
+extern read_result telem_client_read(telem_client* tc, ecu_data* dat);
+extern bool telem_client_connected(const telem_client* tc);
+extern void telem_client_close(telem_client* tc);
+
+#endif
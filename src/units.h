@@ -0,0 +1,22 @@
+#ifndef UNITS_H
+#define UNITS_H
+
+#include <stdint.h>
+
+/*
+ * Lookup tables for the display units, generated at build time by
+ * unittables.cmake and rounded to nearest rather than truncated. Road
+ * speed is a byte, so every value has an entry; temperatures have one
+ * between UNITS_TEMP_MIN_F and UNITS_TEMP_MAX_F, well beyond anything the
+ * sensors report. The script reads the bounds from here.
+ */
+
+#define UNITS_SPEED_COUNT	256
+#define UNITS_TEMP_MIN_F	-128
+#define UNITS_TEMP_MAX_F	511
+#define UNITS_TEMP_COUNT	(UNITS_TEMP_MAX_F - UNITS_TEMP_MIN_F + 1)
+
+extern const uint16_t unitsKphFromMph[UNITS_SPEED_COUNT];
+extern const int16_t unitsCelsiusFromF[UNITS_TEMP_COUNT];
+
+#endif
@@ -0,0 +1,61 @@
+# Writes the tables declared in units.h to OUTPUT:
+#   cmake -DHEADER=src/units.h -DOUTPUT=unittables.c -P unittables.cmake
+# Integer arithmetic only, rounding half away from zero.
+
+file(STRINGS ${HEADER} bounds REGEX "^#define UNITS_(SPEED_COUNT|TEMP_MIN_F|TEMP_MAX_F)")
+
+foreach(line ${bounds})
+	string(REGEX REPLACE "^#define (UNITS_[A-Z_]+)[ \t]+(-?[0-9]+).*$" "\\1;\\2" pair "${line}")
+	list(GET pair 0 name)
+	list(GET pair 1 value)
+	set(${name} ${value})
+endforeach()
+
+if(NOT DEFINED UNITS_SPEED_COUNT OR NOT DEFINED UNITS_TEMP_MIN_F OR NOT DEFINED UNITS_TEMP_MAX_F)
+	message(FATAL_ERROR "Could not read the table bounds from ${HEADER}")
+endif()
+
+# n / d for d > 0, rounded half away from zero
+macro(round_div result n d)
+	if(${n} LESS 0)
+		math(EXPR ${result} "-((-(${n}) + (${d}) / 2) / (${d}))")
+	else()
+		math(EXPR ${result} "((${n}) + (${d}) / 2) / (${d})")
+	endif()
+endmacro()
+
+set(text "/* Generated from units.h by unittables.cmake; do not edit. */\n\n#include \"units.h\"\n\n")
+
+# 1 mile is exactly 1.609344 km
+set(text "${text}const uint16_t unitsKphFromMph[UNITS_SPEED_COUNT] = {")
+math(EXPR last "${UNITS_SPEED_COUNT} - 1")
+
+foreach(mph RANGE ${last})
+	math(EXPR scaled "${mph} * 1609344")
+	round_div(kph ${scaled} 1000000)
+	math(EXPR column "${mph} % 16")
+
+	if(column EQUAL 0)
+		set(text "${text}\n\t${kph},")
+	else()
+		set(text "${text} ${kph},")
+	endif()
+endforeach()
+
+set(text "${text}\n\t};\n\nconst int16_t unitsCelsiusFromF[UNITS_TEMP_COUNT] = {")
+
+foreach(f RANGE ${UNITS_TEMP_MIN_F} ${UNITS_TEMP_MAX_F})
+	math(EXPR scaled "(${f} - 32) * 5")
+	round_div(c ${scaled} 9)
+	math(EXPR column "(${f} - ${UNITS_TEMP_MIN_F}) % 16")
+
+	if(column EQUAL 0)
+		set(text "${text}\n\t${c},")
+	else()
+		set(text "${text} ${c},")
+	endif()
+endforeach()
+
+set(text "${text}\n\t};\n")
+
+file(WRITE ${OUTPUT} "${text}")